@@ -0,0 +1,129 @@
+/*******************************************************************************
+ * Feel free to use, modify, and/or distribute this code as you see fit.
+ ******************************************************************************/
+#include "accuracy_scheduler.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <mutex>
+#include <ostream>
+
+#include "flute.h"
+
+namespace steiner {
+
+namespace {
+
+// Time in nanoseconds per d * log2(d) to solve a net of degree d > FLUTE_D at
+// each accuracy, measured on random nets of 20 to 3000 pins.
+constexpr double kNanosPerPin[AccuracyScheduler::kMaxAccuracy + 1] = {
+    0, 95, 150, 215, 370, 440, 650, 780, 1500, 1700};
+
+// Time in nanoseconds per pin to solve a net from the tables.
+constexpr double kNanosPerTablePin = 100;
+
+// Weight, in nanoseconds of predicted time, of the initial model against the
+// recorded nets, and the decay of the weight of a recorded net per net
+// recorded after it.
+constexpr double kModelWeight = 1e6;
+constexpr double kDecay = 0.9;
+
+}  // namespace
+
+AccuracyScheduler::AccuracyScheduler(Clock::duration net_budget,
+                                     Clock::time_point deadline, bool anytime)
+    : net_budget_(net_budget), deadline_(deadline), anytime_(anytime) {}
+
+AccuracyScheduler::Clock::duration AccuracyScheduler::NetBudget(
+    double share, Clock::duration spent) const {
+  Clock::duration budget = Clock::duration::max();
+  if (net_budget_ > Clock::duration()) {
+    budget = std::max(net_budget_ - spent, Clock::duration());
+  }
+  if (deadline_ != Clock::time_point::max()) {
+    const Clock::duration left =
+        std::max(deadline_ - Clock::now(), Clock::duration());
+    budget = std::min(budget, std::chrono::duration_cast<Clock::duration>(
+                                  left * std::clamp(share, 0.0, 1.0)));
+  }
+  return budget;
+}
+
+AccuracyScheduler::Clock::duration AccuracyScheduler::Predict(
+    int degree, int accuracy) const {
+  double nanos;
+  if (degree <= FLUTE_D) {
+    nanos = kNanosPerTablePin * degree;
+  } else {
+    accuracy = std::clamp(accuracy, kMinAccuracy, kMaxAccuracy);
+    nanos = kNanosPerPin[accuracy] * degree * std::log2(degree) * Scale();
+  }
+  return std::chrono::duration_cast<Clock::duration>(
+      std::chrono::duration<double, std::nano>(nanos));
+}
+
+int AccuracyScheduler::Choose(int degree, Clock::duration budget) const {
+  // The accuracy only matters to nets that are broken.
+  if (degree <= FLUTE_D || budget == Clock::duration::max()) {
+    return kMaxAccuracy;
+  }
+  for (int accuracy = kMaxAccuracy; accuracy > kMinAccuracy; --accuracy) {
+    if (Predict(degree, accuracy) <= budget) {
+      return accuracy;
+    }
+  }
+  return kMinAccuracy;
+}
+
+void AccuracyScheduler::Record(int degree, int accuracy,
+                               Clock::duration elapsed) {
+  if (degree <= FLUTE_D) {
+    return;
+  }
+  accuracy = std::clamp(accuracy, kMinAccuracy, kMaxAccuracy);
+  const double predicted =
+      kNanosPerPin[accuracy] * degree * std::log2(degree);
+  const double measured =
+      std::chrono::duration<double, std::nano>(elapsed).count();
+  std::lock_guard<std::mutex> lock(mutex_);
+  measured_ = measured_ * kDecay + measured;
+  predicted_ = predicted_ * kDecay + predicted;
+}
+
+double AccuracyScheduler::Scale() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return (measured_ + kModelWeight) / (predicted_ + kModelWeight);
+}
+
+void AccuracyScheduler::CountNet(int accuracy, bool upgraded) {
+  accuracy = std::clamp(accuracy, kMinAccuracy, kMaxAccuracy);
+  num_nets_[accuracy].fetch_add(1, std::memory_order_relaxed);
+  if (upgraded) {
+    num_upgrades_.fetch_add(1, std::memory_order_relaxed);
+  }
+}
+
+void AccuracyScheduler::PrintStats(std::ostream& out) const {
+  std::uint64_t num_nets = 0;
+  for (int accuracy = kMinAccuracy; accuracy <= kMaxAccuracy; ++accuracy) {
+    num_nets += num_nets_[accuracy].load(std::memory_order_relaxed);
+  }
+  out << "Accuracy scheduler: " << num_nets << " nets";
+  const char* separator = " (";
+  for (int accuracy = kMinAccuracy; accuracy <= kMaxAccuracy; ++accuracy) {
+    const std::uint64_t n = num_nets_[accuracy].load(std::memory_order_relaxed);
+    if (n > 0) {
+      out << separator << n << " at accuracy " << accuracy;
+      separator = ", ";
+    }
+  }
+  if (num_nets > 0) {
+    out << ")";
+  }
+  out << ", " << num_upgrades_.load(std::memory_order_relaxed)
+      << " upgraded, " << Scale() << "x the modeled time\n";
+}
+
+}  // namespace steiner
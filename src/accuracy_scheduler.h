@@ -0,0 +1,97 @@
+/*******************************************************************************
+ * Feel free to use, modify, and/or distribute this code as you see fit.
+ ******************************************************************************/
+#ifndef ACCURACY_SCHEDULER_H_
+#define ACCURACY_SCHEDULER_H_
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <ostream>
+
+namespace steiner {
+
+// Accuracy scheduler.
+// Chooses the FLUTE accuracy of each net from its degree and the time it may
+// take. FLUTE solves nets of up to FLUTE_D pins from its tables, at any
+// accuracy. Larger nets are broken recursively, trying `accuracy` breakings
+// at the top; they take about k(accuracy) * d * log2(d) to solve, where k
+// grows about twentyfold from accuracy 1 to 9. The scheduler predicts the
+// time of a net from measured k, scaled by how long the nets it was told
+// about actually took, and picks the highest accuracy predicted to fit.
+// A net may take up to the net budget, and the nets of a batch share the
+// time left until the deadline. In anytime mode every net is first solved
+// at the lowest accuracy, and then again at a higher one if the time left
+// allows it. The scheduler may be used from several threads at once.
+class AccuracyScheduler {
+ public:
+  using Clock = std::chrono::steady_clock;
+
+  // Accuracies the scheduler chooses from. The highest one is what
+  // SteinerTreeBuilder uses without a scheduler.
+  static constexpr int kMinAccuracy = 1;
+  static constexpr int kMaxAccuracy = 9;
+
+  // Constructors and destructor.
+  // Each net may take up to `net_budget` (no limit if zero), and all of them
+  // have to be done by `deadline`.
+  explicit AccuracyScheduler(
+      Clock::duration net_budget = Clock::duration(),
+      Clock::time_point deadline = Clock::time_point::max(),
+      bool anytime = false);
+  AccuracyScheduler(const AccuracyScheduler&) = delete;
+  AccuracyScheduler& operator=(const AccuracyScheduler&) = delete;
+  AccuracyScheduler(AccuracyScheduler&&) = delete;
+  AccuracyScheduler& operator=(AccuracyScheduler&&) = delete;
+  ~AccuracyScheduler() = default;
+
+  bool anytime() const { return anytime_; }
+
+  // Returns the time a net may take once it has taken `spent`: what is left
+  // of the net budget, and its `share` (at most 1) of the time left until
+  // the deadline. Clock::duration::max() means no limit.
+  Clock::duration NetBudget(double share = 1.0,
+                            Clock::duration spent = Clock::duration()) const;
+
+  // Returns the predicted time to solve a net of `degree` pins at `accuracy`.
+  Clock::duration Predict(int degree, int accuracy) const;
+
+  // Returns the highest accuracy predicted to solve a net of `degree` pins
+  // within `budget`, or kMinAccuracy if none is.
+  int Choose(int degree, Clock::duration budget) const;
+
+  // Tells the scheduler that a net of `degree` pins took `elapsed` to solve
+  // at `accuracy`, to refine its predictions.
+  void Record(int degree, int accuracy, Clock::duration elapsed);
+
+  // Counts a net whose tree was returned at `accuracy`. `upgraded` is true if
+  // anytime mode got that tree by solving the net again.
+  void CountNet(int accuracy, bool upgraded);
+
+  // Prints the number of nets returned at each accuracy, the number of
+  // upgrades and how much slower than the initial model the nets were.
+  void PrintStats(std::ostream& out) const;
+
+ private:
+  // Returns how much longer than the initial model the recorded nets took.
+  double Scale() const;
+
+  const Clock::duration net_budget_;
+  const Clock::time_point deadline_;
+  const bool anytime_;
+
+  // Measured time over initial prediction, summed over the recorded nets with
+  // exponentially decaying weights.
+  mutable std::mutex mutex_;  // Guards the sums.
+  double measured_ = 0.0;
+  double predicted_ = 0.0;
+
+  std::array<std::atomic<std::uint64_t>, kMaxAccuracy + 1> num_nets_{};
+  std::atomic<std::uint64_t> num_upgrades_{0};
+};
+
+}  // namespace steiner
+
+#endif  // ACCURACY_SCHEDULER_H_
@@ -3,69 +3,780 @@
  ******************************************************************************/
 #include "file_io.h"
 
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <charconv>
+#include <climits>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
 #include <fstream>
 #include <iostream>
+#include <memory>
 #include <string>
 #include <string_view>
+#include <utility>
 #include <vector>
 
 #include "graph.h"
 
 namespace file_io {
 
+namespace {
+
+// Size of the TreeWriter buffer.
+constexpr std::size_t kTreeWriterBufferSize = 1 << 16;
+
+// Large enough for an edge: a newline and four 32-bit integers separated by
+// spaces.
+constexpr std::size_t kMaxEdgeSize = 4 * 12;
+
+// Contents of a file, mapped into memory or, if it cannot be mapped (e.g., a
+// pipe), read in one go.
+class FileContents {
+ public:
+  // Constructors and destructor.
+  FileContents() = default;
+  FileContents(const FileContents&) = delete;
+  FileContents& operator=(const FileContents&) = delete;
+  FileContents(FileContents&&) = delete;
+  FileContents& operator=(FileContents&&) = delete;
+  ~FileContents() {
+    if (map_ != nullptr) {
+      munmap(map_, map_size_);
+    }
+  }
+
+  // Loads the file. Returns false if it cannot be opened.
+  bool Load(const std::string& filename) {
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0) {
+      return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+      void* map = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (map != MAP_FAILED) {
+        map_ = map;
+        map_size_ = st.st_size;
+        text_ = std::string_view(static_cast<const char*>(map_), map_size_);
+        close(fd);
+        return true;
+      }
+    }
+    char chunk[1 << 16];
+    ssize_t n;
+    while ((n = read(fd, chunk, sizeof(chunk))) > 0) {
+      buffer_.append(chunk, n);
+    }
+    close(fd);
+    text_ = buffer_;
+    return n == 0;
+  }
+
+  // Returns the contents.
+  std::string_view text() const { return text_; }
+
+ private:
+  void* map_ = nullptr;
+  std::size_t map_size_ = 0;
+  std::string buffer_;
+  std::string_view text_;
+};
+
+}  // namespace
+
+// Scanner of the integers of the input, whitespace-separated decimals of the
+// text format or those of the binary format, in memory or read in chunks from
+// a file descriptor.
+class InputScanner {
+ public:
+  // Constructors.
+  explicit InputScanner(std::string_view text)
+      : pos_(text.data()), end_(text.data() + text.size()) {}
+  explicit InputScanner(int fd) : fd_(fd), eof_(false) {
+    pos_ = end_ = buffer_.data();
+  }
+
+  // Reads the next integer into `value`. Returns false at the end of the
+  // input or if the next token is not an integer that fits in an int.
+  bool Next(int* value) {
+    SkipSpace();
+
+    // Make sure the whole token is buffered.
+    std::size_t length = 0;
+    while (true) {
+      while (pos_ + length != end_ && !IsSpace(pos_[length])) {
+        ++length;
+      }
+      if (pos_ + length != end_ || !Refill(length + 1)) {
+        break;
+      }
+    }
+
+    const char* token = pos_;
+    pos_ += length;
+    bool negative = false;
+    if (length > 0 && *token == '-') {
+      negative = true;
+      ++token;
+      --length;
+    }
+    if (length == 0 || length > 10) {
+      return false;
+    }
+    long long magnitude = 0;
+    for (std::size_t i = 0; i < length; ++i) {
+      if (!IsDigit(token[i])) {
+        return false;
+      }
+      magnitude = magnitude * 10 + (token[i] - '0');
+    }
+    const long long limit = negative ? -static_cast<long long>(INT_MIN)
+                                     : static_cast<long long>(INT_MAX);
+    if (magnitude > limit) {
+      return false;
+    }
+    *value = static_cast<int>(negative ? -magnitude : magnitude);
+    return true;
+  }
+
+  // Reads an unsigned 32-bit integer of the binary format. Returns false at
+  // the end of the input.
+  bool ReadU32(std::uint32_t* value) {
+    if (!HasAtLeast(4)) {
+      return false;
+    }
+    const auto* bytes = reinterpret_cast<const unsigned char*>(pos_);
+    *value = static_cast<std::uint32_t>(bytes[0]) |
+             static_cast<std::uint32_t>(bytes[1]) << 8 |
+             static_cast<std::uint32_t>(bytes[2]) << 16 |
+             static_cast<std::uint32_t>(bytes[3]) << 24;
+    pos_ += 4;
+    return true;
+  }
+
+  // Reads a signed 32-bit integer of the binary format. Returns false at the
+  // end of the input.
+  bool ReadI32(int* value) {
+    std::uint32_t bits;
+    if (!ReadU32(&bits)) {
+      return false;
+    }
+    *value = static_cast<std::int32_t>(bits);
+    return true;
+  }
+
+  // Reads a zigzag varint as the difference to `reference`. Returns false at
+  // the end of the input or if the varint is longer than 5 bytes.
+  bool ReadDelta(int reference, int* value) {
+    std::uint32_t bits = 0;
+    for (int shift = 0; shift < 35; shift += 7) {
+      if (pos_ == end_ && !Refill(1)) {
+        return false;
+      }
+      const auto byte = static_cast<unsigned char>(*pos_++);
+      bits |= static_cast<std::uint32_t>(byte & 0x7f) << shift;
+      if ((byte & 0x80) == 0) {
+        const std::uint32_t delta = (bits >> 1) ^ (0u - (bits & 1));
+        *value = static_cast<std::int32_t>(
+            static_cast<std::uint32_t>(reference) + delta);
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // Reads a coordinate of the binary format, packed or as the difference to
+  // `reference`.
+  bool ReadCoordinate(bool delta_varint, int reference, int* value) {
+    return delta_varint ? ReadDelta(reference, value) : ReadI32(value);
+  }
+
+  // Skips whitespace and returns true if the next bytes are `prefix`.
+  bool StartsWith(std::string_view prefix) {
+    SkipSpace();
+    return HasAtLeast(prefix.size()) &&
+           std::memcmp(pos_, prefix.data(), prefix.size()) == 0;
+  }
+
+  // Returns true if only whitespace is left.
+  bool AtEnd() {
+    SkipSpace();
+    return pos_ == end_;
+  }
+
+  // Returns true if at least `size` more bytes are left. Reads ahead from the
+  // file descriptor as needed.
+  bool HasAtLeast(std::size_t size) {
+    return static_cast<std::size_t>(end_ - pos_) >= size || Refill(size);
+  }
+
+  // Returns true if no byte is left.
+  bool Exhausted() { return !HasAtLeast(1); }
+
+ private:
+  // Size of the reads from the file descriptor.
+  static constexpr std::size_t kChunkSize = 1 << 16;
+
+  static bool IsDigit(char c) { return c >= '0' && c <= '9'; }
+  static bool IsSpace(char c) {
+    return c == ' ' || c == '\n' || c == '\r' || c == '\t' || c == '\v' ||
+           c == '\f';
+  }
+
+  void SkipSpace() {
+    do {
+      while (pos_ != end_ && IsSpace(*pos_)) {
+        ++pos_;
+      }
+    } while (pos_ == end_ && Refill(1));
+  }
+
+  // Reads from the file descriptor until at least `size` bytes are left.
+  // Returns false if the input ends first.
+  bool Refill(std::size_t size) {
+    if (eof_) {
+      return false;
+    }
+    buffer_.erase(0, pos_ - buffer_.data());
+    while (buffer_.size() < size) {
+      const std::size_t used = buffer_.size();
+      buffer_.resize(used + kChunkSize);
+      ssize_t n;
+      do {
+        n = read(fd_, buffer_.data() + used, buffer_.size() - used);
+      } while (n < 0 && errno == EINTR);
+      if (n < 0) {
+        std::cerr << "Failed to read the input: " << std::strerror(errno)
+                  << "\n";
+      }
+      buffer_.resize(used + std::max<ssize_t>(n, 0));
+      if (n <= 0) {
+        eof_ = true;
+        break;
+      }
+    }
+    pos_ = buffer_.data();
+    end_ = pos_ + buffer_.size();
+    return buffer_.size() >= size;
+  }
+
+  const char* pos_;
+  const char* end_;
+  int fd_ = -1;       // File descriptor to refill from, if any.
+  bool eof_ = true;   // True once the file descriptor is exhausted.
+  std::string buffer_;  // Unconsumed input read from the file descriptor.
+};
+
+namespace {
+
+// Checks the boundary of net `net_index`. Returns false if it is empty.
+bool CheckBoundary(const graph::Boundary_i& boundary, std::size_t net_index) {
+  if (boundary.xl > boundary.xh || boundary.yl > boundary.yh) {
+    std::cerr << "Empty boundary in net " << net_index << "\n";
+    return false;
+  }
+  return true;
+}
+
+// Checks a node of net `net_index`. Returns false if it is outside the
+// boundary.
+bool CheckNode(const graph::Boundary_i& boundary, int x, int y,
+               std::size_t net_index) {
+  if (x < boundary.xl || x > boundary.xh || y < boundary.yl ||
+      y > boundary.yh) {
+    std::cerr << "Node (" << x << ", " << y << ") of net " << net_index
+              << " is outside its boundary\n";
+    return false;
+  }
+  return true;
+}
+
+// Parses a net in the input file format. `net_index` numbers the net in
+// error messages. Returns false if the net is malformed.
+bool ParseNet(InputScanner* scanner, std::size_t net_index,
+              graph::Boundary_i* boundary, std::vector<graph::Node_i>* nodes) {
+  if (!scanner->Next(&boundary->xl) || !scanner->Next(&boundary->yl) ||
+      !scanner->Next(&boundary->xh) || !scanner->Next(&boundary->yh)) {
+    std::cerr << "Invalid boundary in net " << net_index << "\n";
+    return false;
+  }
+  if (!CheckBoundary(*boundary, net_index)) {
+    return false;
+  }
+
+  // Every node takes at least 4 bytes ("\nx y"), which bounds a count that
+  // can be trusted before reserving for it.
+  int num_nodes = 0;
+  if (!scanner->Next(&num_nodes) || num_nodes < 0 ||
+      !scanner->HasAtLeast(4 * static_cast<std::size_t>(num_nodes))) {
+    std::cerr << "Invalid node count in net " << net_index << "\n";
+    return false;
+  }
+
+  nodes->clear();
+  nodes->reserve(num_nodes);
+  for (int i = 0; i < num_nodes; ++i) {
+    int x = 0, y = 0;
+    if (!scanner->Next(&x) || !scanner->Next(&y)) {
+      std::cerr << "Invalid or missing node " << i << " in net " << net_index
+                << "\n";
+      return false;
+    }
+    if (!CheckNode(*boundary, x, y, net_index)) {
+      return false;
+    }
+    nodes->emplace_back(x, y);
+  }
+  return true;
+}
+
+// Parses a tree in the output file format. `tree_index` numbers the tree in
+// error messages. Returns false if the tree is malformed.
+bool ParseTree(InputScanner* scanner, std::size_t tree_index,
+               std::vector<graph::Edge_i>* edges) {
+  // Every edge takes at least 8 bytes ("\na b c d").
+  int num_edges = 0;
+  if (!scanner->Next(&num_edges) || num_edges < 0 ||
+      !scanner->HasAtLeast(8 * static_cast<std::size_t>(num_edges))) {
+    std::cerr << "Invalid edge count in tree " << tree_index << "\n";
+    return false;
+  }
+
+  edges->clear();
+  edges->reserve(num_edges);
+  for (int i = 0; i < num_edges; ++i) {
+    int x1 = 0, y1 = 0, x2 = 0, y2 = 0;
+    if (!scanner->Next(&x1) || !scanner->Next(&y1) || !scanner->Next(&x2) ||
+        !scanner->Next(&y2)) {
+      std::cerr << "Invalid or missing edge " << i << " in tree "
+                << tree_index << "\n";
+      return false;
+    }
+    edges->emplace_back(graph::Node_i(x1, y1), graph::Node_i(x2, y2));
+  }
+  return true;
+}
+
+// Appends the decimal representation of `value` to `out`.
+void AppendInt(std::string* out, long long value) {
+  char digits[24];
+  out->append(digits, std::to_chars(digits, digits + sizeof(digits), value).ptr);
+}
+
+// Appends a net in the input file format to `out`.
+void AppendNet(std::string* out, const graph::Net_i& net) {
+  const graph::Boundary_i& boundary = net.boundary;
+  AppendInt(out, boundary.xl);
+  *out += ' ';
+  AppendInt(out, boundary.yl);
+  *out += ' ';
+  AppendInt(out, boundary.xh);
+  *out += ' ';
+  AppendInt(out, boundary.yh);
+  *out += '\n';
+  AppendInt(out, static_cast<long long>(net.nodes.size()));
+  *out += '\n';
+  for (const graph::Node_i& node : net.nodes) {
+    AppendInt(out, node.x);
+    *out += ' ';
+    AppendInt(out, node.y);
+    *out += '\n';
+  }
+}
+
+// The binary format.
+// All integers are little-endian. A file starts with a 16-byte header:
+// ---------------------------
+// [magic: 4 bytes, "SNET" for nets or "STRE" for trees]
+// [version: uint32]
+// [flags: uint32, kBinaryDeltaVarint if coordinates are delta-varints]
+// [record_count: uint32]
+// ---------------------------
+// followed by one record per net:
+// ---------------------------
+// [boundary_xl: int32] [boundary_yl: int32] [boundary_xh: int32]
+// [boundary_yh: int32] [node_count: uint32] [nodes]
+// ---------------------------
+// or per tree:
+// ---------------------------
+// [edge_count: uint32] [edges]
+// ---------------------------
+// Packed coordinates are int32s: "x y" per node and "x1 y1 x2 y2" per edge.
+// Delta-varint coordinates are zigzag LEB128 varints of the difference to a
+// reference point: a node to the previous node (the first one to the
+// lower-left corner of the boundary), the start of an edge to the end of the
+// previous edge (the first one to the origin), and the end of an edge to its
+// start.
+constexpr char kBinaryNetsMagic[4] = {'S', 'N', 'E', 'T'};
+constexpr char kBinaryTreesMagic[4] = {'S', 'T', 'R', 'E'};
+constexpr std::uint32_t kBinaryVersion = 1;
+constexpr std::uint32_t kBinaryDeltaVarint = 1;
+constexpr std::size_t kBinaryHeaderSize = 16;
+
+// Returns true if `text` starts with the 4-byte `magic`.
+bool HasMagic(std::string_view text, const char (&magic)[4]) {
+  return text.size() >= 4 && std::memcmp(text.data(), magic, 4) == 0;
+}
+
+// Appends an unsigned 32-bit integer in the binary format to `out`.
+void AppendU32(std::string* out, std::uint32_t value) {
+  const char bytes[4] = {static_cast<char>(value), static_cast<char>(value >> 8),
+                         static_cast<char>(value >> 16),
+                         static_cast<char>(value >> 24)};
+  out->append(bytes, 4);
+}
+
+// Appends `value` as a zigzag varint of the difference to `reference`.
+void AppendDelta(std::string* out, int reference, int value) {
+  const std::uint32_t delta =
+      static_cast<std::uint32_t>(value) - static_cast<std::uint32_t>(reference);
+  std::uint32_t bits = (delta << 1) ^ (0u - (delta >> 31));
+  while (bits >= 0x80) {
+    *out += static_cast<char>(bits | 0x80);
+    bits >>= 7;
+  }
+  *out += static_cast<char>(bits);
+}
+
+// Appends a coordinate, packed or as the difference to `reference`.
+void AppendCoordinate(std::string* out, bool delta_varint, int reference,
+                      int value) {
+  if (delta_varint) {
+    AppendDelta(out, reference, value);
+  } else {
+    AppendU32(out, static_cast<std::uint32_t>(value));
+  }
+}
+
+// Appends the header of a binary file to `out`.
+void AppendBinaryHeader(std::string* out, const char (&magic)[4],
+                        BinaryEncoding encoding, std::size_t num_records) {
+  out->append(magic, 4);
+  AppendU32(out, kBinaryVersion);
+  AppendU32(out,
+            encoding == BinaryEncoding::kDeltaVarint ? kBinaryDeltaVarint : 0);
+  AppendU32(out, static_cast<std::uint32_t>(num_records));
+}
+
+// Reads the header of a binary file, whose magic the caller has checked.
+// Returns false if the header is malformed or of an unsupported version.
+bool ReadBinaryHeader(InputScanner* scanner, std::uint32_t* num_records,
+                      bool* delta_varint) {
+  std::uint32_t magic, version, flags;
+  if (!scanner->ReadU32(&magic) || !scanner->ReadU32(&version) ||
+      !scanner->ReadU32(&flags) || !scanner->ReadU32(num_records)) {
+    std::cerr << "Truncated binary header\n";
+    return false;
+  }
+  if (version != kBinaryVersion || (flags & ~kBinaryDeltaVarint) != 0) {
+    std::cerr << "Unsupported binary format version " << version
+              << " (flags " << flags << ")\n";
+    return false;
+  }
+  *delta_varint = (flags & kBinaryDeltaVarint) != 0;
+  return true;
+}
+
+// Parses a net record of the binary format. `net_index` numbers the net in
+// error messages. Returns false if the net is malformed.
+bool ParseBinaryNet(InputScanner* scanner, bool delta_varint,
+                    std::size_t net_index, graph::Boundary_i* boundary,
+                    std::vector<graph::Node_i>* nodes) {
+  if (!scanner->ReadI32(&boundary->xl) || !scanner->ReadI32(&boundary->yl) ||
+      !scanner->ReadI32(&boundary->xh) || !scanner->ReadI32(&boundary->yh)) {
+    std::cerr << "Invalid boundary in net " << net_index << "\n";
+    return false;
+  }
+  if (!CheckBoundary(*boundary, net_index)) {
+    return false;
+  }
+
+  // Every node takes at least 2 bytes, or 8 bytes if packed.
+  std::uint32_t num_nodes = 0;
+  if (!scanner->ReadU32(&num_nodes) ||
+      !scanner->HasAtLeast(num_nodes * std::size_t{delta_varint ? 2u : 8u})) {
+    std::cerr << "Invalid node count in net " << net_index << "\n";
+    return false;
+  }
+
+  nodes->clear();
+  nodes->reserve(num_nodes);
+  int x = boundary->xl, y = boundary->yl;
+  for (std::uint32_t i = 0; i < num_nodes; ++i) {
+    if (!scanner->ReadCoordinate(delta_varint, x, &x) ||
+        !scanner->ReadCoordinate(delta_varint, y, &y)) {
+      std::cerr << "Invalid or missing node " << i << " in net " << net_index
+                << "\n";
+      return false;
+    }
+    if (!CheckNode(*boundary, x, y, net_index)) {
+      return false;
+    }
+    nodes->emplace_back(x, y);
+  }
+  return true;
+}
+
+// Parses a tree record of the binary format. `tree_index` numbers the tree in
+// error messages. Returns false if the tree is malformed.
+bool ParseBinaryTree(InputScanner* scanner, bool delta_varint,
+                     std::size_t tree_index,
+                     std::vector<graph::Edge_i>* edges) {
+  // Every edge takes at least 4 bytes, or 16 bytes if packed.
+  std::uint32_t num_edges = 0;
+  if (!scanner->ReadU32(&num_edges) ||
+      !scanner->HasAtLeast(num_edges * std::size_t{delta_varint ? 4u : 16u})) {
+    std::cerr << "Invalid edge count in tree " << tree_index << "\n";
+    return false;
+  }
+
+  edges->clear();
+  edges->reserve(num_edges);
+  int x1 = 0, y1 = 0, x2 = 0, y2 = 0;
+  for (std::uint32_t i = 0; i < num_edges; ++i) {
+    if (!scanner->ReadCoordinate(delta_varint, x2, &x1) ||
+        !scanner->ReadCoordinate(delta_varint, y2, &y1) ||
+        !scanner->ReadCoordinate(delta_varint, x1, &x2) ||
+        !scanner->ReadCoordinate(delta_varint, y1, &y2)) {
+      std::cerr << "Invalid or missing edge " << i << " in tree "
+                << tree_index << "\n";
+      return false;
+    }
+    edges->emplace_back(graph::Node_i(x1, y1), graph::Node_i(x2, y2));
+  }
+  return true;
+}
+
+// Appends a net record of the binary format to `out`.
+void AppendBinaryNet(std::string* out, const graph::Net_i& net,
+                     bool delta_varint) {
+  const graph::Boundary_i& boundary = net.boundary;
+  AppendU32(out, static_cast<std::uint32_t>(boundary.xl));
+  AppendU32(out, static_cast<std::uint32_t>(boundary.yl));
+  AppendU32(out, static_cast<std::uint32_t>(boundary.xh));
+  AppendU32(out, static_cast<std::uint32_t>(boundary.yh));
+  AppendU32(out, static_cast<std::uint32_t>(net.nodes.size()));
+  int x = boundary.xl, y = boundary.yl;
+  for (const graph::Node_i& node : net.nodes) {
+    AppendCoordinate(out, delta_varint, x, node.x);
+    AppendCoordinate(out, delta_varint, y, node.y);
+    x = node.x;
+    y = node.y;
+  }
+}
+
+// Appends a tree record of the binary format to `out`.
+void AppendBinaryTree(std::string* out, const std::vector<graph::Edge_i>& edges,
+                      bool delta_varint) {
+  AppendU32(out, static_cast<std::uint32_t>(edges.size()));
+  int x = 0, y = 0;
+  for (const graph::Edge_i& edge : edges) {
+    AppendCoordinate(out, delta_varint, x, edge.start.x);
+    AppendCoordinate(out, delta_varint, y, edge.start.y);
+    AppendCoordinate(out, delta_varint, edge.start.x, edge.end.x);
+    AppendCoordinate(out, delta_varint, edge.start.y, edge.end.y);
+    x = edge.end.x;
+    y = edge.end.y;
+  }
+}
+
+// Parses the nets of a binary nets file and returns the `encoding` of their
+// coordinates. Returns false if the file is malformed.
+bool ParseBinaryNets(InputScanner* scanner, std::vector<graph::Net_i>* nets,
+                     BinaryEncoding* encoding) {
+  std::uint32_t num_nets = 0;
+  bool delta_varint = false;
+  if (!ReadBinaryHeader(scanner, &num_nets, &delta_varint)) {
+    return false;
+  }
+  *encoding =
+      delta_varint ? BinaryEncoding::kDeltaVarint : BinaryEncoding::kPacked;
+  // Every net takes at least 20 bytes.
+  if (!scanner->HasAtLeast(20 * std::size_t{num_nets})) {
+    std::cerr << "Invalid net count " << num_nets << "\n";
+    return false;
+  }
+  nets->clear();
+  nets->resize(num_nets);
+  for (std::uint32_t i = 0; i < num_nets; ++i) {
+    if (!ParseBinaryNet(scanner, delta_varint, i, &(*nets)[i].boundary,
+                        &(*nets)[i].nodes)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Parses the nets of a binary nets file, which must hold nothing else.
+// Returns false if it is malformed.
+bool ParseBinaryNetsFile(std::string_view data,
+                         std::vector<graph::Net_i>* nets) {
+  InputScanner scanner(data);
+  BinaryEncoding encoding;
+  if (!ParseBinaryNets(&scanner, nets, &encoding)) {
+    return false;
+  }
+  if (!scanner.Exhausted()) {
+    std::cerr << "Unexpected data after the nets\n";
+    return false;
+  }
+  return true;
+}
+
+// Parses the trees of a binary trees file. Returns false if it is malformed.
+bool ParseBinaryTreesFile(std::string_view data,
+                          std::vector<std::vector<graph::Edge_i>>* trees) {
+  InputScanner scanner(data);
+  std::uint32_t num_trees = 0;
+  bool delta_varint = false;
+  if (!ReadBinaryHeader(&scanner, &num_trees, &delta_varint)) {
+    return false;
+  }
+  // Every tree takes at least 4 bytes.
+  if (!scanner.HasAtLeast(4 * std::size_t{num_trees})) {
+    std::cerr << "Invalid tree count " << num_trees << "\n";
+    return false;
+  }
+  trees->clear();
+  trees->resize(num_trees);
+  for (std::uint32_t i = 0; i < num_trees; ++i) {
+    if (!ParseBinaryTree(&scanner, delta_varint, i, &(*trees)[i])) {
+      return false;
+    }
+  }
+  if (!scanner.Exhausted()) {
+    std::cerr << "Unexpected data after the trees\n";
+    return false;
+  }
+  return true;
+}
+
+// Writes `data` to the output file. Returns false if an error occurred.
+bool WriteData(std::string_view filename, std::string_view data) {
+  const int fd = OpenOutputFile(filename);
+  if (fd < 0) {
+    return false;
+  }
+  bool ok;
+  {
+    TreeWriter writer(fd);
+    writer.Write(data);
+    ok = writer.Flush();
+  }
+  return CloseFile(fd) && ok;
+}
+
+}  // namespace
+
 bool ReadInputFile(std::string_view filename, graph::Boundary_i* boundary,
                    std::vector<graph::Node_i>* nodes) {
-  // Open the input file.
-  std::ifstream fin(filename.data());
-  if (!fin.is_open()) {
+  // Load the input file.
+  FileContents contents;
+  if (!contents.Load(std::string(filename))) {
     std::cerr << "Failed to open the input file: " << filename << "\n";
     return false;
   }
 
-  // NOTE: This is a simple file parser. No error handling is implemented.
-  // Make sure the input file is well-formed.
+  // A binary input file holds a single net.
+  if (HasMagic(contents.text(), kBinaryNetsMagic)) {
+    std::vector<graph::Net_i> nets;
+    if (!ParseBinaryNetsFile(contents.text(), &nets)) {
+      return false;
+    }
+    if (nets.size() != 1) {
+      std::cerr << "Expected a single net, found " << nets.size() << "\n";
+      return false;
+    }
+    *boundary = nets[0].boundary;
+    *nodes = std::move(nets[0].nodes);
+    return true;
+  }
+
   // The input file format is as follows:
   // ---------------------------
-  // [boundary_xl] [boundary_yh] [boundary_xh] [boundary_yh]
+  // [boundary_xl] [boundary_yl] [boundary_xh] [boundary_yh]
   // [node_count]
   // [x1] [y1]
   // [x2] [y2]
   // ...
   // [xn] [yn]
   // ---------------------------
+  InputScanner scanner(contents.text());
+  if (!ParseNet(&scanner, 0, boundary, nodes)) {
+    return false;
+  }
+  if (!scanner.AtEnd()) {
+    std::cerr << "Unexpected data after the nodes\n";
+    return false;
+  }
 
-  // Read the boundary.
-  int min_x = 0, min_y = 0, max_x = 0, max_y = 0;
-  fin >> min_x >> min_y >> max_x >> max_y;
-  boundary->xl = min_x;
-  boundary->yl = min_y;
-  boundary->xh = max_x;
-  boundary->yh = max_y;
+  return true;
+}
 
-  // Read the number of nodes.
-  int num_nodes = 0;
-  fin >> num_nodes;
+int OpenInputFile(std::string_view filename) {
+  if (filename == "-") {
+    return STDIN_FILENO;
+  }
+  return open(std::string(filename).c_str(), O_RDONLY);
+}
 
-  // Read the nodes.
-  nodes->resize(num_nodes);
-  for (int i = 0; i < num_nodes; ++i) {
-    fin >> (*nodes)[i].x >> (*nodes)[i].y;
+int OpenOutputFile(std::string_view filename) {
+  if (filename == "-") {
+    return STDOUT_FILENO;
   }
+  return open(std::string(filename).c_str(), O_WRONLY | O_CREAT | O_TRUNC,
+              0644);
+}
 
-  // Close the input file.
-  fin.close();
+bool CloseFile(int fd) {
+  return fd == STDIN_FILENO || fd == STDOUT_FILENO || close(fd) == 0;
+}
 
-  return true;
+NetReader::NetReader(int fd) : scanner_(std::make_unique<InputScanner>(fd)) {}
+
+NetReader::~NetReader() = default;
+
+bool NetReader::Next(graph::Net_i* net) {
+  if (!ok_ || scanner_->AtEnd()) {
+    return false;
+  }
+  ok_ = ParseNet(scanner_.get(), num_nets_++, &net->boundary, &net->nodes);
+  return ok_;
 }
 
-bool WriteOutputFile(std::string_view filename,
-                     const std::vector<graph::Edge_i>& edges) {
-  // Open the output file.
-  std::ofstream fout(filename.data());
-  if (!fout.is_open()) {
+bool NetReader::NextRequest(NetRequest* request) {
+  if (!ok_ || scanner_->AtEnd()) {
     return false;
   }
+  request->binary = scanner_->StartsWith(
+      std::string_view(kBinaryNetsMagic, sizeof(kBinaryNetsMagic)));
+  if (request->binary) {
+    ok_ = ParseBinaryNets(scanner_.get(), &request->nets, &request->encoding);
+    num_nets_ += request->nets.size();
+    return ok_;
+  }
+  request->nets.resize(1);
+  return Next(&request->nets[0]);
+}
+
+bool IsBinaryFile(std::string_view filename) {
+  constexpr std::string_view kExtension = ".bin";
+  return filename.size() >= kExtension.size() &&
+         filename.substr(filename.size() - kExtension.size()) == kExtension;
+}
 
+TreeWriter::TreeWriter(int fd) : fd_(fd), buffer_(kTreeWriterBufferSize) {}
+
+TreeWriter::~TreeWriter() { Flush(); }
+
+void TreeWriter::WriteTree(const std::vector<graph::Edge_i>& edges) {
   // The output file format is as follows:
   // ---------------------------
   // [edge_count]
@@ -76,19 +787,251 @@ bool WriteOutputFile(std::string_view filename,
   // ---------------------------
 
   // Write the number of edges.
-  fout << edges.size();
+  Reserve(kMaxEdgeSize);
+  WriteInt(static_cast<long long>(edges.size()));
 
   // Write the edges.
   for (const graph::Edge_i& edge : edges) {
-    fout << "\n"
-         << edge.start.x << " " << edge.start.y << " " << edge.end.x << " "
-         << edge.end.y;
+    Reserve(kMaxEdgeSize);
+    char* out = buffer_.data() + size_;
+    *out++ = '\n';
+    out = std::to_chars(out, out + 11, edge.start.x).ptr;
+    *out++ = ' ';
+    out = std::to_chars(out, out + 11, edge.start.y).ptr;
+    *out++ = ' ';
+    out = std::to_chars(out, out + 11, edge.end.x).ptr;
+    *out++ = ' ';
+    out = std::to_chars(out, out + 11, edge.end.y).ptr;
+    size_ = out - buffer_.data();
+  }
+}
+
+void TreeWriter::WriteBinaryTrees(
+    const std::vector<std::vector<graph::Edge_i>>& trees,
+    BinaryEncoding encoding) {
+  std::string data;
+  AppendBinaryHeader(&data, kBinaryTreesMagic, encoding, trees.size());
+  for (const std::vector<graph::Edge_i>& edges : trees) {
+    AppendBinaryTree(&data, edges, encoding == BinaryEncoding::kDeltaVarint);
+  }
+  Write(data);
+}
+
+void TreeWriter::WriteLine(long long value) {
+  Reserve(kMaxEdgeSize);
+  WriteInt(value);
+  buffer_[size_++] = '\n';
+}
+
+void TreeWriter::Write(std::string_view text) {
+  if (text.size() > buffer_.size()) {
+    Flush();
+    buffer_.resize(text.size());
+  }
+  Reserve(text.size());
+  std::memcpy(buffer_.data() + size_, text.data(), text.size());
+  size_ += text.size();
+}
+
+bool TreeWriter::Flush() {
+  const char* data = buffer_.data();
+  std::size_t left = size_;
+  while (ok_ && left > 0) {
+    ssize_t written = write(fd_, data, left);
+    if (written < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      ok_ = false;
+      break;
+    }
+    data += written;
+    left -= written;
+  }
+  size_ = 0;
+  return ok_;
+}
+
+void TreeWriter::Reserve(std::size_t size) {
+  if (size_ + size > buffer_.size()) {
+    Flush();
+  }
+}
+
+void TreeWriter::WriteInt(long long value) {
+  char* out = buffer_.data() + size_;
+  size_ = std::to_chars(out, buffer_.data() + buffer_.size(), value).ptr -
+          buffer_.data();
+}
+
+bool WriteOutputFile(std::string_view filename,
+                     const std::vector<graph::Edge_i>& edges,
+                     BinaryEncoding encoding) {
+  // A binary output file holds a single tree.
+  if (IsBinaryFile(filename)) {
+    std::string data;
+    AppendBinaryHeader(&data, kBinaryTreesMagic, encoding, 1);
+    AppendBinaryTree(&data, edges, encoding == BinaryEncoding::kDeltaVarint);
+    return WriteData(filename, data);
+  }
+
+  // Open the output file.
+  const int fd = OpenOutputFile(filename);
+  if (fd < 0) {
+    return false;
+  }
+
+  bool ok;
+  {
+    TreeWriter writer(fd);
+    writer.WriteTree(edges);
+    ok = writer.Flush();
   }
 
   // Close the output file.
-  fout.close();
+  return CloseFile(fd) && ok;
+}
+
+bool ReadNetsFile(std::string_view filename, std::vector<graph::Net_i>* nets) {
+  // Load the input file.
+  FileContents contents;
+  if (!contents.Load(std::string(filename))) {
+    std::cerr << "Failed to open the input file: " << filename << "\n";
+    return false;
+  }
 
+  if (HasMagic(contents.text(), kBinaryNetsMagic)) {
+    return ParseBinaryNetsFile(contents.text(), nets);
+  }
+
+  // The multi-net file is a sequence of nets in the input file format:
+  // ---------------------------
+  // [boundary_xl] [boundary_yl] [boundary_xh] [boundary_yh]
+  // [node_count]
+  // [x1] [y1]
+  // ...
+  // [boundary_xl] [boundary_yl] [boundary_xh] [boundary_yh]
+  // [node_count]
+  // ...
+  // ---------------------------
+  nets->clear();
+  InputScanner scanner(contents.text());
+  while (!scanner.AtEnd()) {
+    graph::Net_i& net = nets->emplace_back();
+    if (!ParseNet(&scanner, nets->size() - 1, &net.boundary, &net.nodes)) {
+      return false;
+    }
+  }
   return true;
 }
 
+bool WriteNetsFile(std::string_view filename,
+                   const std::vector<graph::Net_i>& nets,
+                   BinaryEncoding encoding) {
+  std::string data;
+  if (IsBinaryFile(filename)) {
+    AppendBinaryHeader(&data, kBinaryNetsMagic, encoding, nets.size());
+    for (const graph::Net_i& net : nets) {
+      AppendBinaryNet(&data, net, encoding == BinaryEncoding::kDeltaVarint);
+    }
+  } else {
+    for (const graph::Net_i& net : nets) {
+      AppendNet(&data, net);
+    }
+  }
+  return WriteData(filename, data);
+}
+
+bool ReadTreesFile(std::string_view filename,
+                   std::vector<std::vector<graph::Edge_i>>* trees) {
+  // Load the trees file.
+  FileContents contents;
+  if (!contents.Load(std::string(filename))) {
+    std::cerr << "Failed to open the trees file: " << filename << "\n";
+    return false;
+  }
+
+  if (HasMagic(contents.text(), kBinaryTreesMagic)) {
+    return ParseBinaryTreesFile(contents.text(), trees);
+  }
+
+  // A sequence of trees in the output file format.
+  trees->clear();
+  InputScanner scanner(contents.text());
+  while (!scanner.AtEnd()) {
+    std::vector<graph::Edge_i>& edges = trees->emplace_back();
+    if (!ParseTree(&scanner, trees->size() - 1, &edges)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool WriteTreesFile(std::string_view filename,
+                    const std::vector<std::vector<graph::Edge_i>>& trees,
+                    BinaryEncoding encoding) {
+  // Open the output file.
+  const int fd = OpenOutputFile(filename);
+  if (fd < 0) {
+    return false;
+  }
+
+  // Write every tree in the output file format, or as a binary trees file.
+  bool ok;
+  {
+    TreeWriter writer(fd);
+    if (IsBinaryFile(filename)) {
+      writer.WriteBinaryTrees(trees, encoding);
+    } else {
+      for (const std::vector<graph::Edge_i>& edges : trees) {
+        writer.WriteTree(edges);
+        writer.Write("\n");
+      }
+    }
+    ok = writer.Flush();
+  }
+
+  // Close the output file.
+  return CloseFile(fd) && ok;
+}
+
+bool WriteLengthsFile(std::string_view filename,
+                      const std::vector<long long>& lengths) {
+  // Open the output file.
+  const int fd = OpenOutputFile(filename);
+  if (fd < 0) {
+    return false;
+  }
+
+  // Write every length on its own line.
+  bool ok;
+  {
+    TreeWriter writer(fd);
+    for (long long length : lengths) {
+      writer.WriteLine(length);
+    }
+    ok = writer.Flush();
+  }
+
+  // Close the output file.
+  return CloseFile(fd) && ok;
+}
+
+bool ReadManifestFile(std::string_view filename,
+                      std::vector<std::pair<std::string, std::string>>* jobs) {
+  // Open the manifest file.
+  std::ifstream fin(filename.data());
+  if (!fin.is_open()) {
+    std::cerr << "Failed to open the manifest file: " << filename << "\n";
+    return false;
+  }
+
+  jobs->clear();
+  std::string input_file, output_file;
+  while (fin >> input_file >> output_file) {
+    jobs->emplace_back(input_file, output_file);
+  }
+  return fin.eof();
+}
+
 }  // namespace file_io
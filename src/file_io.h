@@ -4,21 +4,167 @@
 #ifndef FILE_IO_H_
 #define FILE_IO_H_
 
+#include <cstddef>
+#include <memory>
 #include <string>
 #include <string_view>
+#include <utility>
 #include <vector>
 
 #include "graph.h"
 
 namespace file_io {
 
-// Reads the input file. Returns false if an error occurred.
+// Encodings of the coordinates of the binary format (see file_io.cc).
+enum class BinaryEncoding {
+  kPacked,       // 32-bit integers.
+  kDeltaVarint,  // Zigzag varints of the differences between coordinates.
+};
+
+// Opens a file for reading, or returns the standard input if `filename` is
+// "-". Returns -1 if the file cannot be opened.
+int OpenInputFile(std::string_view filename);
+
+// Opens a file for writing, or returns the standard output if `filename` is
+// "-". Returns -1 if the file cannot be opened.
+int OpenOutputFile(std::string_view filename);
+
+// Closes a file opened by OpenInputFile or OpenOutputFile. Returns false if an
+// error occurred.
+bool CloseFile(int fd);
+
+// Returns true if `filename` selects the binary format, i.e., ends in ".bin".
+// Readers recognize binary files by their header regardless of the name.
+bool IsBinaryFile(std::string_view filename);
+
+class InputScanner;
+
+// A request of a client: a net in the input file format, or the nets of a
+// binary nets file.
+struct NetRequest {
+  std::vector<graph::Net_i> nets;
+  bool binary = false;
+  BinaryEncoding encoding = BinaryEncoding::kDeltaVarint;  // If binary.
+};
+
+// Reader of a stream of nets in the input file format from a file descriptor.
+// Nets are parsed as they arrive, so that only the net being read is
+// buffered.
+class NetReader {
+ public:
+  // Constructors and destructor.
+  // The reader does not own `fd`.
+  explicit NetReader(int fd);
+  NetReader(const NetReader&) = delete;
+  NetReader& operator=(const NetReader&) = delete;
+  NetReader(NetReader&&) = delete;
+  NetReader& operator=(NetReader&&) = delete;
+  ~NetReader();
+
+  // Reads the next net. Returns false at the end of the stream or if the net
+  // is malformed (see ok()).
+  bool Next(graph::Net_i* net);
+
+  // Reads the next request: a binary nets file if the stream continues with
+  // one, or else a single net. Returns false at the end of the stream or if
+  // the request is malformed (see ok()).
+  bool NextRequest(NetRequest* request);
+
+  // Returns false once a malformed net has been read.
+  bool ok() const { return ok_; }
+
+ private:
+  std::unique_ptr<InputScanner> scanner_;
+  std::size_t num_nets_ = 0;  // Number of nets read, for error messages.
+  bool ok_ = true;
+};
+
+// Reads the input file, in the input file format or a binary nets file with a
+// single net. Returns false if an error occurred.
 bool ReadInputFile(std::string_view filename, graph::Boundary_i* boundary,
                    std::vector<graph::Node_i>* nodes);
 
-// Writes the output file. Returns false if an error occurred.
-bool WriteOutputFile(std::string_view filename,
-                     const std::vector<graph::Edge_i>& edges);
+// Buffered writer of trees in the output file format to a file descriptor.
+// Integers are formatted into a reusable buffer, which goes out in a few
+// large writes.
+class TreeWriter {
+ public:
+  // Constructors and destructor.
+  // The writer does not own `fd`.
+  explicit TreeWriter(int fd);
+  TreeWriter(const TreeWriter&) = delete;
+  TreeWriter& operator=(const TreeWriter&) = delete;
+  TreeWriter(TreeWriter&&) = delete;
+  TreeWriter& operator=(TreeWriter&&) = delete;
+  ~TreeWriter();
+
+  // Appends a tree in the output file format, without a trailing newline.
+  void WriteTree(const std::vector<graph::Edge_i>& edges);
+
+  // Appends trees as a binary trees file.
+  void WriteBinaryTrees(const std::vector<std::vector<graph::Edge_i>>& trees,
+                        BinaryEncoding encoding);
+
+  // Appends raw data.
+  void Write(std::string_view text);
+
+  // Appends an integer on a line of its own.
+  void WriteLine(long long value);
+
+  // Writes out the buffered data. Returns false if this or any earlier write
+  // failed.
+  bool Flush();
+
+ private:
+  // Makes room for `size` more bytes in the buffer.
+  void Reserve(std::size_t size);
+
+  // Appends an integer.
+  void WriteInt(long long value);
+
+  int fd_;
+  std::vector<char> buffer_;
+  std::size_t size_ = 0;  // Number of buffered bytes.
+  bool ok_ = true;        // False once a write has failed.
+};
+
+// Writes the output file, or the standard output if `filename` is "-". A
+// binary output file holds a single tree. Returns false if an error occurred.
+bool WriteOutputFile(
+    std::string_view filename, const std::vector<graph::Edge_i>& edges,
+    BinaryEncoding encoding = BinaryEncoding::kDeltaVarint);
+
+// Reads a multi-net file, i.e., a sequence of nets in the input file format,
+// or a binary nets file. Returns false if an error occurred.
+bool ReadNetsFile(std::string_view filename, std::vector<graph::Net_i>* nets);
+
+// Writes a multi-net file, or the standard output if `filename` is "-".
+// Returns false if an error occurred.
+bool WriteNetsFile(std::string_view filename,
+                   const std::vector<graph::Net_i>& nets,
+                   BinaryEncoding encoding = BinaryEncoding::kDeltaVarint);
+
+// Reads a multi-tree file, i.e., a sequence of trees in the output file
+// format, or a binary trees file. Returns false if an error occurred.
+bool ReadTreesFile(std::string_view filename,
+                   std::vector<std::vector<graph::Edge_i>>* trees);
+
+// Writes a multi-tree file, i.e., a sequence of trees in the output file
+// format, one per net, or the standard output if `filename` is "-". Returns
+// false if an error occurred.
+bool WriteTreesFile(std::string_view filename,
+                    const std::vector<std::vector<graph::Edge_i>>& trees,
+                    BinaryEncoding encoding = BinaryEncoding::kDeltaVarint);
+
+// Writes one length per line, or to the standard output if `filename` is "-".
+// Returns false if an error occurred.
+bool WriteLengthsFile(std::string_view filename,
+                      const std::vector<long long>& lengths);
+
+// Reads a manifest file listing one "[input_file] [output_file]" pair per
+// line. Returns false if an error occurred.
+bool ReadManifestFile(std::string_view filename,
+                      std::vector<std::pair<std::string, std::string>>* jobs);
 
 }  // namespace file_io
 
@@ -0,0 +1,120 @@
+/*******************************************************************************
+ * Feel free to use, modify, and/or distribute this code as you see fit.
+ ******************************************************************************/
+#ifndef FLAT_HASH_MAP_H_
+#define FLAT_HASH_MAP_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "graph.h"
+
+namespace steiner {
+
+// Hash functions of the keys of FlatHashMap. Linear probing needs the low
+// bits of a hash to be well mixed, which std::hash<int> (the identity) does
+// not provide.
+template <typename Key>
+struct FlatHash;
+
+template <>
+struct FlatHash<int> {
+  std::size_t operator()(int key) const {
+    return static_cast<std::size_t>(
+        graph::MixKey(static_cast<std::uint32_t>(key)));
+  }
+};
+
+template <>
+struct FlatHash<graph::Node_i> {
+  std::size_t operator()(const graph::Node_i& key) const {
+    return static_cast<std::size_t>(graph::MixKey(graph::PackNode(key)));
+  }
+};
+
+// Flat hash map.
+// An open-addressing hash map with linear probing over a single array of
+// slots, so that a lookup touches one or two cache lines instead of chasing
+// the node pointers of std::unordered_map. Keys are never removed. Growing the
+// map moves its values, which invalidates references to them.
+template <typename Key, typename Value, typename Hash = FlatHash<Key>>
+class FlatHashMap {
+ public:
+  // Constructors and destructor.
+  FlatHashMap() = default;
+  FlatHashMap(const FlatHashMap&) = delete;
+  FlatHashMap& operator=(const FlatHashMap&) = delete;
+  FlatHashMap(FlatHashMap&&) = default;
+  FlatHashMap& operator=(FlatHashMap&&) = default;
+  ~FlatHashMap() = default;
+
+  // Returns the value of `key`, or nullptr if there is none.
+  const Value* Find(const Key& key) const {
+    if (slots_.empty()) {
+      return nullptr;
+    }
+    const Slot& slot = slots_[Probe(key)];
+    return slot.used ? &slot.value : nullptr;
+  }
+
+  // Returns the value of `key`, adding a default-constructed one if needed.
+  Value& operator[](const Key& key) {
+    // Keep the load factor at most 3/4.
+    if (4 * (size_ + 1) > 3 * slots_.size()) {
+      Grow();
+    }
+    Slot& slot = slots_[Probe(key)];
+    if (!slot.used) {
+      slot.key = key;
+      slot.used = true;
+      ++size_;
+    }
+    return slot.value;
+  }
+
+  // Returns the number of keys.
+  std::size_t size() const { return size_; }
+
+ private:
+  static constexpr std::size_t kMinCapacity = 16;
+
+  struct Slot {
+    Key key{};
+    bool used = false;
+    Value value{};
+  };
+
+  // Returns the slot of `key`, or the empty slot where it belongs.
+  std::size_t Probe(const Key& key) const {
+    const std::size_t mask = slots_.size() - 1;
+    std::size_t i = Hash()(key) & mask;
+    while (slots_[i].used && !(slots_[i].key == key)) {
+      i = (i + 1) & mask;
+    }
+    return i;
+  }
+
+  // Doubles the number of slots.
+  void Grow() {
+    std::vector<Slot> old_slots(
+        slots_.empty() ? kMinCapacity : 2 * slots_.size());
+    old_slots.swap(slots_);
+    for (Slot& old_slot : old_slots) {
+      if (old_slot.used) {
+        Slot& slot = slots_[Probe(old_slot.key)];
+        slot.key = old_slot.key;
+        slot.used = true;
+        slot.value = std::move(old_slot.value);
+      }
+    }
+  }
+
+  std::vector<Slot> slots_;  // A power of two of them, or none.
+  std::size_t size_ = 0;     // Number of used slots.
+};
+
+}  // namespace steiner
+
+#endif  // FLAT_HASH_MAP_H_
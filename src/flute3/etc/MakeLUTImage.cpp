@@ -0,0 +1,60 @@
+// Usage: MakeLUTImage image_file
+//        MakeLUTImage --cpp var_name cpp_file
+//
+// Decodes the LUTs compiled into flute and saves them as a precompiled LUT
+// image (see Flute::writeLUTImage), which Flute::readLUTImage maps in place.
+// With --cpp, the image is written as a C++ source file defining
+//   extern const unsigned char var_name[];
+//   extern const size_t var_name_size;
+// to be compiled in and passed to Flute::useLUTImage.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include "flute.h"
+
+static bool
+writeCpp(const char *var, const char *image_file, const char *cpp_file) {
+  FILE *in = fopen(image_file, "rb");
+  if (in == NULL)
+    return false;
+  std::vector<unsigned char> image;
+  unsigned char buf[1 << 16];
+  size_t n;
+  while ((n = fread(buf, 1, sizeof(buf), in)) > 0)
+    image.insert(image.end(), buf, buf + n);
+  fclose(in);
+
+  FILE *out = fopen(cpp_file, "w");
+  if (out == NULL)
+    return false;
+  fprintf(out, "#include <stddef.h>\n");
+  fprintf(out, "namespace Flute {\n");
+  fprintf(out, "extern const unsigned char %s[];\n", var);
+  fprintf(out, "extern const size_t %s_size;\n", var);
+  fprintf(out, "alignas(8) const unsigned char %s[] = {", var);
+  for (size_t i = 0; i < image.size(); i++)
+    fprintf(out, "%s%u,", i % 32 == 0 ? "\n" : "", image[i]);
+  fprintf(out, "\n};\n");
+  fprintf(out, "const size_t %s_size = %zu;\n", var, image.size());
+  fprintf(out, "}\n");
+  return fclose(out) == 0;
+}
+
+int main(int argc, char **argv) {
+  if (argc == 2) {
+    return Flute::writeLUTImage(argv[1]) ? EXIT_SUCCESS : EXIT_FAILURE;
+  }
+  if (argc == 4 && strcmp(argv[1], "--cpp") == 0) {
+    std::string image_file = std::string(argv[3]) + ".lut";
+    bool ok = Flute::writeLUTImage(image_file.c_str())
+      && writeCpp(argv[2], image_file.c_str(), argv[3]);
+    remove(image_file.c_str());
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+  }
+  fprintf(stderr, "Usage: %s image_file\n", argv[0]);
+  fprintf(stderr, "       %s --cpp var_name cpp_file\n", argv[0]);
+  return EXIT_FAILURE;
+}
@@ -32,11 +32,27 @@
 #include <string.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
 #include <ctype.h>
 #include <limits.h>
 #include <math.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define FLUTE_X86_SIMD 1
+#include <immintrin.h>
+#endif
 #include <string>
+#include <type_traits>
 #include <algorithm>
+#include <array>
+#include <atomic>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+#include <vector>
 #include "flute.h"
 
 namespace Flute {
@@ -53,28 +69,161 @@ namespace Flute {
 #endif
 int numgrp[10] = {0, 0, 0, 0, 6, 30, 180, 1260, 10080, 90720};
 
+// A candidate POWV as it is encoded in the POWV file. Its wirelength is that
+// of POWV `parent` plus the segments seg[0..] and minus the segments seg[..10].
 struct csoln {
         unsigned char parent;
         unsigned char seg[11];        // Add: 0..i, Sub: j..10; seg[i+1]=seg[j-1]=0
+};
+
+// The Steiner tree (POST) of a candidate POWV. It is only read for the best
+// POWV, so it is kept apart from the coefficients scanned for every candidate.
+struct cpost {
         unsigned char rowcol[FLUTE_D - 2];  // row = rowcol[]/16, col = rowcol[]%16,
-        unsigned char neighbor[2 * FLUTE_D - 2];
+        unsigned char neighbor[FLUTE_D - 1];  // 2 per byte, even ones in high nibble
 };
 
-// struct csoln *LUT[FLUTE_D + 1][MGROUP];  // storing 4 .. FLUTE_D
-// int numsoln[FLUTE_D + 1][MGROUP];
+// The wirelength of a POWV of degree d is the span of the net plus a linear
+// combination of the 2*(d-3) inner segment lengths, i.e. the vertical ones
+// between rows 1..d-2 followed by the horizontal ones between columns 1..d-2.
+// POWVs are scored POWV_LANES at a time from blocks of coefficients, each
+// holding one row of POWV_LANES coefficients per segment.
+#define POWV_LANES 8
+#define POWV_NSEG(d) (2 * ((d) - 3))
+
+// The LUT of one degree, flattened. The POWVs of group k are
+// first[k] .. first[k] + numsoln[k] - 1. POWV i has its coefficients in block
+// i / POWV_LANES of coef[], at lane i % POWV_LANES, and its tree at post[i].
+// Groups start on a block boundary, so the unused lanes of their last block
+// are padding. A group that is the same as some previous group shares its
+// POWVs.
+struct lutd {
+        const uint32_t *first;
+        const unsigned char *numsoln;
+        const unsigned char *coef;
+        const struct cpost *post;
+};
 
-typedef struct csoln ***LUT_TYPE;
-typedef int **NUMSOLN_TYPE;
+// Contiguous storage of a LUT decoded at run time.
+struct lutd_storage {
+        std::vector<uint32_t> first;
+        std::vector<unsigned char> numsoln;
+        std::vector<unsigned char> coef;
+        std::vector<struct cpost> post;
+};
 
-// Dynamically allocate LUTs.
-LUT_TYPE LUT;
-NUMSOLN_TYPE numsoln;
+// LUTs for degrees 4 .. FLUTE_D, pointing either into lut_storage or into a
+// LUT image.
+static struct lutd LUT[FLUTE_D + 1];
+static struct lutd_storage lut_storage[FLUTE_D + 1];
 
-struct point {
-        DTYPE x, y;
-        int o;
-};
+// Index of segment seg, as numbered in the POWV file, among the coefficients.
+static inline int
+powvSegment(int d, int seg) {
+  return seg <= d - 3 ? seg - 1 : seg - 3;
+}
+
+static inline int
+postNeighbor(const struct cpost *p, int i) {
+  unsigned char c = p->neighbor[i / 2];
+  return (i % 2 == 0) ? c / 16 : c % 16;
+}
+
+////////////////////////////////////////////////////////////////
+
+// POWV scoring kernels.
+// Each one sets l[i] = base + sum of dd[s] * coefficient s of POWV i for the
+// nblock * POWV_LANES POWVs of nblock consecutive coefficient blocks.
+typedef void (*ScorePOWVs)(const unsigned char *coef,
+                           int nseg,
+                           int nblock,
+                           const DTYPE dd[],
+                           DTYPE base,
+                           DTYPE l[]);
+
+static void
+scorePOWVsScalar(const unsigned char *coef,
+                 int nseg,
+                 int nblock,
+                 const DTYPE dd[],
+                 DTYPE base,
+                 DTYPE l[]) {
+  for (int b = 0; b < nblock; b++) {
+    for (int i = 0; i < POWV_LANES; i++)
+      l[i] = base;
+    for (int s = 0; s < nseg; s++) {
+      for (int i = 0; i < POWV_LANES; i++)
+        l[i] += dd[s] * coef[i];
+      coef += POWV_LANES;
+    }
+    l += POWV_LANES;
+  }
+}
+
+#ifdef FLUTE_X86_SIMD
+static_assert(std::is_same<DTYPE, int32_t>::value,
+              "SIMD POWV kernels score 32-bit integer lengths");
+
+__attribute__((target("sse4.1"))) static void
+scorePOWVsSSE41(const unsigned char *coef,
+                int nseg,
+                int nblock,
+                const DTYPE dd[],
+                DTYPE base,
+                DTYPE l[]) {
+  for (int b = 0; b < nblock; b++) {
+    __m128i lo = _mm_set1_epi32(base);
+    __m128i hi = lo;
+    for (int s = 0; s < nseg; s++) {
+      __m128i c = _mm_loadl_epi64((const __m128i *)coef);
+      __m128i w = _mm_set1_epi32(dd[s]);
+      lo = _mm_add_epi32(lo, _mm_mullo_epi32(w, _mm_cvtepu8_epi32(c)));
+      hi = _mm_add_epi32(hi, _mm_mullo_epi32(w, _mm_cvtepu8_epi32(_mm_srli_si128(c, 4))));
+      coef += POWV_LANES;
+    }
+    _mm_storeu_si128((__m128i *)l, lo);
+    _mm_storeu_si128((__m128i *)(l + 4), hi);
+    l += POWV_LANES;
+  }
+}
+
+__attribute__((target("avx2"))) static void
+scorePOWVsAVX2(const unsigned char *coef,
+               int nseg,
+               int nblock,
+               const DTYPE dd[],
+               DTYPE base,
+               DTYPE l[]) {
+  for (int b = 0; b < nblock; b++) {
+    __m256i sum = _mm256_set1_epi32(base);
+    for (int s = 0; s < nseg; s++) {
+      __m128i c = _mm_loadl_epi64((const __m128i *)coef);
+      sum = _mm256_add_epi32(sum, _mm256_mullo_epi32(_mm256_set1_epi32(dd[s]),
+                                                     _mm256_cvtepu8_epi32(c)));
+      coef += POWV_LANES;
+    }
+    _mm256_storeu_si256((__m256i *)l, sum);
+    l += POWV_LANES;
+  }
+}
+#endif
+
+static ScorePOWVs
+selectScorePOWVs() {
+#ifdef FLUTE_X86_SIMD
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2"))
+    return scorePOWVsAVX2;
+  if (__builtin_cpu_supports("sse4.1"))
+    return scorePOWVsSSE41;
+#endif
+  return scorePOWVsScalar;
+}
 
+static const ScorePOWVs scorePOWVs = selectScorePOWVs();
+
+static DTYPE solveWlMD(int d, DTYPE xs[], DTYPE ys[], int s[], int acc);
+static Tree solveMD(int d, DTYPE xs[], DTYPE ys[], int s[], int acc);
 Tree dmergetree(Tree t1, Tree t2);
 Tree hmergetree(Tree t1, Tree t2, int s[]);
 Tree vmergetree(Tree t1, Tree t2);
@@ -90,118 +239,393 @@ template <class T> inline T ADIFF(T x, T y) {
 
 ////////////////////////////////////////////////////////////////
 
-static void
-readLUTfiles(LUT_TYPE LUT,
-	     NUMSOLN_TYPE numsoln) {
-        unsigned char charnum[256], line[32], *linep, c;
-        FILE *fpwv, *fprt;
-        struct csoln *p;
-        int d, i, j, k, kk, ns, nn;
-
-        for (i = 0; i <= 255; i++) {
-                if ('0' <= i && i <= '9')
-                        charnum[i] = i - '0';
-                else if (i >= 'A')
-                        charnum[i] = i - 'A' + 10;
-                else  // if (i=='$' || i=='\n' || ... )
-                        charnum[i] = 0;
-        }
+// Low-degree kernels.
+// flutes_LD() and flutes_wl_LD() look the net up in the LUT of its degree
+// with an instance of these for each degree D = 4..FLUTE_D, taken from a
+// dispatch table. Every loop runs on compile-time bounds and is unrolled, so
+// the leaves of the flutes_MD() recursion run straight-line code.
+
+// Returns the group of the pins in LUT[D], with the POWVs of a horizontal
+// flip of the net if *hflip is set, and fills dd[] with the inner segment
+// lengths in the order of the coefficients of the group.
+template <int D>
+static inline int
+groupLD(const DTYPE xs[], const DTYPE ys[], const int s[],
+        DTYPE dd[], bool *hflip) {
+  int k = (s[0] < s[2]) + (s[1] < s[2]);
+#pragma GCC unroll 16
+  for (int i = 3; i <= D - 1; i++) {  // p0=0 always, skip i=1 for symmetry
+    int pi = s[i];
+#pragma GCC unroll 16
+    for (int j = D - 1; j > i; j--)
+      pi -= s[j] < s[i];
+    k = pi + (i + 1) * k;
+  }
 
-        fpwv = fopen(FLUTE_POWVFILE, "r");
-        if (fpwv == NULL) {
-                printf("Error in opening %s\n", FLUTE_POWVFILE);
-                exit(1);
-        }
+  *hflip = k >= numgrp[D];
+  if (*hflip)
+    k = 2 * numgrp[D] - 1 - k;
+#pragma GCC unroll 16
+  for (int i = 1; i <= D - 3; i++) {
+    dd[i - 1] = ys[i + 1] - ys[i];
+    dd[D - 4 + i] = *hflip ? xs[D - 1 - i] - xs[D - 2 - i]
+                           : xs[i + 1] - xs[i];
+  }
+  return k;
+}
 
-#if FLUTE_ROUTING == 1
-        fprt = fopen(FLUTE_POSTFILE, "r");
-        if (fprt == NULL) {
-                printf("Error in opening %s\n", FLUTE_POSTFILE);
-                exit(1);
+// Scores the POWVs of the group of the pins. Returns the length of the best
+// one and sets *best to it and *hflip as groupLD() does.
+template <int D>
+static inline DTYPE
+bestPOWV(const DTYPE xs[], const DTYPE ys[], const int s[],
+         const struct cpost **best, bool *hflip) {
+  constexpr int nseg = POWV_NSEG(D);
+  DTYPE dd[nseg];
+  DTYPE l[(MPOWV + POWV_LANES - 1) / POWV_LANES * POWV_LANES];
+
+  const int k = groupLD<D>(xs, ys, s, dd, hflip);
+  const int j = LUT[D].first[k];
+  const int ns = LUT[D].numsoln[k];
+  scorePOWVs(LUT[D].coef + j * nseg, nseg, (ns + POWV_LANES - 1) / POWV_LANES,
+             dd, xs[D - 1] - xs[0] + ys[D - 1] - ys[0], l);
+  DTYPE minl = l[0];
+  int besti = 0;
+  for (int i = 1; i < ns; i++) {
+    if (l[i] < minl) {
+      minl = l[i];
+      besti = i;
+    }
+  }
+  *best = LUT[D].post + j + besti;
+  return minl;
+}
+
+template <int D>
+static DTYPE
+flutesWlLD(const DTYPE xs[], const DTYPE ys[], const int s[]) {
+  const struct cpost *best;
+  bool hflip;
+  return bestPOWV<D>(xs, ys, s, &best, &hflip);
+}
+
+// Sets the 2 * D - 2 branches of the tree and returns its length.
+template <int D>
+static DTYPE
+flutesTreeLD(const DTYPE xs[], const DTYPE ys[], const int s[],
+             Branch branch[]) {
+  const struct cpost *best;
+  bool hflip;
+  const DTYPE minl = bestPOWV<D>(xs, ys, s, &best, &hflip);
+
+#pragma GCC unroll 16
+  for (int i = 0; i < D; i++) {
+    branch[i].x = xs[s[i]];
+    branch[i].y = ys[i];
+  }
+#pragma GCC unroll 16
+  for (int i = 2; i < D - 2; i++)
+    branch[i].n = postNeighbor(best, i);
+  // The groups do not tell the first two pins apart, nor the last two; the
+  // order of their columns decides which neighbor each one takes.
+  const bool swap_first = hflip ? s[1] < s[0] : s[0] < s[1];
+  const bool swap_last = hflip ? s[D - 1] < s[D - 2] : s[D - 2] < s[D - 1];
+  branch[0].n = postNeighbor(best, swap_first ? 1 : 0);
+  branch[1].n = postNeighbor(best, swap_first ? 0 : 1);
+  branch[D - 2].n = postNeighbor(best, swap_last ? D - 1 : D - 2);
+  branch[D - 1].n = postNeighbor(best, swap_last ? D - 2 : D - 1);
+#pragma GCC unroll 16
+  for (int i = D; i < 2 * D - 2; i++) {
+    const int col = best->rowcol[i - D] % 16;
+    branch[i].x = xs[hflip ? D - 1 - col : col];
+    branch[i].y = ys[best->rowcol[i - D] / 16];
+    branch[i].n = postNeighbor(best, i);
+  }
+  return minl;
+}
+
+typedef DTYPE (*WlKernelLD)(const DTYPE xs[], const DTYPE ys[], const int s[]);
+typedef DTYPE (*TreeKernelLD)(const DTYPE xs[], const DTYPE ys[],
+                              const int s[], Branch branch[]);
+
+// Kernels by degree, null below 4.
+template <int... Ds>
+static constexpr std::array<WlKernelLD, FLUTE_D + 1>
+makeWlKernelsLD(std::integer_sequence<int, Ds...>) {
+  return {{(Ds >= 4 ? &flutesWlLD<std::max(Ds, 4)> : nullptr)...}};
+}
+
+template <int... Ds>
+static constexpr std::array<TreeKernelLD, FLUTE_D + 1>
+makeTreeKernelsLD(std::integer_sequence<int, Ds...>) {
+  return {{(Ds >= 4 ? &flutesTreeLD<std::max(Ds, 4)> : nullptr)...}};
+}
+
+static constexpr std::array<WlKernelLD, FLUTE_D + 1> wlKernelsLD =
+    makeWlKernelsLD(std::make_integer_sequence<int, FLUTE_D + 1>());
+static constexpr std::array<TreeKernelLD, FLUTE_D + 1> treeKernelsLD =
+    makeTreeKernelsLD(std::make_integer_sequence<int, FLUTE_D + 1>());
+
+////////////////////////////////////////////////////////////////
+
+// Scratch memory of the FLUTE recursion.
+// While flute() or flute_wl() runs, the recursion takes its scratch arrays
+// and the branches of its intermediate trees from a per-thread bump arena
+// instead of the heap, and fluteFree() is a no-op. Each flutes_MD() level
+// releases what it allocated but the tree it returns, which it moves down
+// to where its allocations started, so the arena stays about as large as
+// the live data. Chunks are kept for the next call on the thread, so once
+// warm a call allocates nothing on the heap but the branches of its result.
+// Outside such a call, e.g. when flutes_MD() is called directly,
+// fluteAlloc() and fluteFree() are malloc() and free().
+struct arena_chunk {
+        char *data;
+        size_t size;
+};
+
+struct arena_mark {
+        size_t chunk;  // chunk being filled
+        size_t used;   // bytes used in it
+};
+
+struct arena {
+        std::vector<struct arena_chunk> chunks;
+        struct arena_mark top = {0, 0};
+        int depth = 0;  // number of open arena_scopes
+        ~arena() {
+          for (struct arena_chunk &chunk : chunks)
+            free(chunk.data);
         }
-#endif
+};
 
-        for (d = 4; d <= FLUTE_D; d++) {
-                fscanf(fpwv, "d=%d", &d);
-                fgetc(fpwv);    // '/n'
-#if FLUTE_ROUTING == 1
-                fscanf(fprt, "d=%d", &d);
-                fgetc(fprt);    // '/n'
-#endif
-                for (k = 0; k < numgrp[d]; k++) {
-			ns = (int)charnum[fgetc(fpwv)];
-
-                        if (ns == 0) {  // same as some previous group
-                                fscanf(fpwv, "%d", &kk);
-                                fgetc(fpwv); // '/n'
-                                numsoln[d][k] = numsoln[d][kk];
-                                LUT[d][k] = LUT[d][kk];
-                        } else {
-                                fgetc(fpwv);  // '\n'
-                                numsoln[d][k] = ns;
-                                p = (struct csoln *)malloc(ns * sizeof(struct csoln));
-                                LUT[d][k] = p;
-                                for (i = 1; i <= ns; i++) {
-                                        linep = (unsigned char *)fgets((char *)line, 32, fpwv);
-                                        p->parent = charnum[*(linep++)];
-                                        j = 0;
-                                        while ((p->seg[j++] = charnum[*(linep++)]) != 0)
-                                                ;
-                                        j = 10;
-                                        while ((p->seg[j--] = charnum[*(linep++)]) != 0)
-                                                ;
-#if FLUTE_ROUTING == 1
-                                        nn = 2 * d - 2;
-                                        fread(line, 1, d - 2, fprt);
-                                        linep = line;
-                                        for (j = d; j < nn; j++) {
-                                                c = charnum[*(linep++)];
-                                                p->rowcol[j - d] = c;
-                                        }
-                                        fread(line, 1, nn / 2 + 1, fprt);
-                                        linep = line;  // last char \n
-					for (j = 0; j < nn;) {
-                                                c = *(linep++);
-                                                p->neighbor[j++] = c / 16;
-                                                p->neighbor[j++] = c % 16;
-                                        }
-#endif
-                                        p++;
-                                }
-                        }
-                }
+static thread_local struct arena flute_arena;
+
+static void clearMemo();
+
+// Makes the thread allocate from its arena while in scope, and releases
+// everything allocated in the scope when it ends, along with the memo of
+// subproblems if it is the outermost scope.
+struct arena_scope {
+        struct arena_mark mark;
+        arena_scope() : mark(flute_arena.top) { flute_arena.depth++; }
+        ~arena_scope() {
+          flute_arena.top = mark;
+          if (--flute_arena.depth == 0)
+            clearMemo();
         }
-	fclose(fpwv);
-#if FLUTE_ROUTING == 1
-	fclose(fprt);
-#endif
+        arena_scope(const arena_scope &) = delete;
+        arena_scope &operator=(const arena_scope &) = delete;
+};
+
+static void *
+fluteAlloc(size_t size) {
+  struct arena *a = &flute_arena;
+  if (a->depth == 0)
+    return malloc(size);
+
+  size = (size + 15) & ~(size_t)15;
+  // Take the first fit at or after the top, so that moving blocks down to a
+  // mark (see arenaKeep) never moves one past where it was.
+  for (; a->top.chunk < a->chunks.size(); a->top.chunk++, a->top.used = 0) {
+    struct arena_chunk *chunk = &a->chunks[a->top.chunk];
+    if (a->top.used + size <= chunk->size) {
+      void *p = chunk->data + a->top.used;
+      a->top.used += size;
+      return p;
+    }
+  }
+  size_t chunk_size = a->chunks.empty() ? 1 << 16 : 2 * a->chunks.back().size;
+  chunk_size = std::max(chunk_size, size);
+  struct arena_chunk chunk = {(char *)malloc(chunk_size), chunk_size};
+  if (chunk.data == NULL) {
+    printf("Out of memory in FLUTE arena\n");
+    exit(1);
+  }
+  a->chunks.push_back(chunk);
+  a->top.used = size;
+  return chunk.data;
+}
+
+static void
+fluteFree(void *p) {
+  if (flute_arena.depth == 0)
+    free(p);
+}
+
+static struct arena_mark
+arenaMark() {
+  return flute_arena.top;
+}
+
+// Releases everything allocated since mark.
+static void
+arenaRelease(struct arena_mark mark) {
+  if (flute_arena.depth > 0)
+    flute_arena.top = mark;
+}
+
+// Releases everything allocated since mark but the branches of t1 and, if
+// not NULL, t2, which are moved down to mark in that order. They must have
+// been allocated in that order after mark.
+static void
+arenaKeep(struct arena_mark mark, Tree *t1, Tree *t2) {
+  if (flute_arena.depth == 0)
+    return;
+  flute_arena.top = mark;
+  for (Tree *t : {t1, t2}) {
+    if (t != NULL && t->branch != NULL) {
+      size_t size = (2 * t->deg - 2) * sizeof(Branch);
+      Branch *branch = (Branch *)fluteAlloc(size);
+      memmove(branch, t->branch, size);
+      t->branch = branch;
+    }
+  }
 }
 
 ////////////////////////////////////////////////////////////////
 
+// Memo of subproblems.
+// The breakings of a net share many subproblems: the same pins, with the
+// same coordinates and order, are solved again at the same accuracy from
+// other breakings, mostly at the low accuracies of the deep levels. While
+// flute() or flute_wl() runs, flutes_MD() and flutes_wl_MD() remember the
+// tree or wirelength of each subproblem they solve in a per-thread memo, up
+// to FLUTE_MEMO_BYTES, and answer it again from there. An entry is keyed
+// on the whole subproblem, compared in full, so the results are the same.
+// The memo is cleared when the call returns, keeping its capacity.
+struct memo_entry {
+        int d, acc;
+        bool tree;      // a tree, or only a wirelength
+        int next;       // next entry of the same hash, or -1
+        size_t input;   // xs[], ys[] and s[] in memo::inputs
+        size_t branch;  // branches in memo::branches, if tree
+        DTYPE length;
+};
+
+struct memo {
+        std::unordered_map<uint64_t, int> index;  // first entry by hash
+        std::vector<struct memo_entry> entries;
+        std::vector<DTYPE> inputs;
+        std::vector<Branch> branches;
+        size_t bytes = 0;
+};
+
+static thread_local struct memo flute_memo;
+
 static void
-makeLUT(LUT_TYPE &LUT,
-	NUMSOLN_TYPE &numsoln);
+clearMemo() {
+  struct memo *m = &flute_memo;
+  if (m->bytes == 0)
+    return;
+  m->index.clear();
+  m->entries.clear();
+  m->inputs.clear();
+  m->branches.clear();
+  m->bytes = 0;
+}
+
+// Returns the key of a subproblem, or 0 if it is not to be memoized: outside
+// flute() and flute_wl(), or at an accuracy above 3. Breakings halve the
+// accuracy down to 1, so those subproblems lie near the top of the
+// recursion, where different breakings hardly ever lead to the same one.
+static uint64_t
+memoKey(int d, const DTYPE xs[], const DTYPE ys[], const int s[], int acc,
+        bool tree) {
+  if (flute_arena.depth == 0 || acc > 3)
+    return 0;
+  uint64_t h = ((uint64_t)d << 32) ^ ((uint64_t)acc << 1) ^ tree;
+  for (int i = 0; i < d; i++) {
+    h = (h ^ (uint32_t)xs[i]) * 0x9e3779b97f4a7c15ULL;
+    h = (h ^ (uint32_t)ys[i]) * 0x9e3779b97f4a7c15ULL;
+    h = (h ^ (uint32_t)s[i]) * 0xff51afd7ed558ccdULL;
+  }
+  h ^= h >> 32;
+  return h | 1;
+}
+
+// Returns the entry of a subproblem with the given key, or NULL.
+static const struct memo_entry *
+findMemo(uint64_t key, int d, const DTYPE xs[], const DTYPE ys[],
+         const int s[], int acc, bool tree) {
+  struct memo *m = &flute_memo;
+  if (key == 0 || m->bytes == 0)
+    return NULL;
+  auto it = m->index.find(key);
+  if (it == m->index.end())
+    return NULL;
+  for (int e = it->second; e >= 0; e = m->entries[e].next) {
+    const struct memo_entry &entry = m->entries[e];
+    const DTYPE *input = m->inputs.data() + entry.input;
+    if (entry.d == d && entry.acc == acc && entry.tree == tree &&
+        memcmp(input, xs, d * sizeof(DTYPE)) == 0 &&
+        memcmp(input + d, ys, d * sizeof(DTYPE)) == 0 &&
+        memcmp(input + 2 * d, s, d * sizeof(int)) == 0)
+      return &entry;
+  }
+  return NULL;
+}
+
+// Remembers the tree t, if not NULL, or else the wirelength length, of a
+// subproblem with the given key, unless the memo is full.
 static void
-deleteLUT(LUT_TYPE &LUT,
-	  NUMSOLN_TYPE &numsoln);
+addMemo(uint64_t key, int d, const DTYPE xs[], const DTYPE ys[],
+        const int s[], int acc, const Tree *t, DTYPE length) {
+  struct memo *m = &flute_memo;
+  if (key == 0)
+    return;
+  size_t bytes = sizeof(struct memo_entry) + 3 * d * sizeof(DTYPE) + 32;
+  if (t != NULL)
+    bytes += (2 * d - 2) * sizeof(Branch);
+  if (m->bytes + bytes > FLUTE_MEMO_BYTES)
+    return;
+  m->bytes += bytes;
+
+  struct memo_entry entry;
+  entry.d = d;
+  entry.acc = acc;
+  entry.tree = t != NULL;
+  entry.input = m->inputs.size();
+  m->inputs.insert(m->inputs.end(), xs, xs + d);
+  m->inputs.insert(m->inputs.end(), ys, ys + d);
+  m->inputs.insert(m->inputs.end(), s, s + d);
+  entry.branch = m->branches.size();
+  if (t != NULL)
+    m->branches.insert(m->branches.end(), t->branch, t->branch + 2 * d - 2);
+  entry.length = t != NULL ? t->length : length;
+  auto inserted = m->index.emplace(key, (int)m->entries.size());
+  entry.next = inserted.second ? -1 : inserted.first->second;
+  inserted.first->second = (int)m->entries.size();
+  m->entries.push_back(entry);
+}
+
+////////////////////////////////////////////////////////////////
+
 static void
-initLUT(int to_d,
-        LUT_TYPE LUT,
-	NUMSOLN_TYPE numsoln);
+parseLUT(const char *pwv,
+         const char *prt,
+         int from_d,
+         int to_d,
+         struct lutd_storage storage[],
+         struct lutd lut[]);
 static void
-ensureLUT(int d);
+clearLUT(struct lutd_storage storage[],
+         struct lutd lut[]);
 static std::string
 base64_decode(std::string const& encoded_string);
 static void
-checkLUT(LUT_TYPE LUT1,
-	 NUMSOLN_TYPE numsoln1,
-	 LUT_TYPE LUT2,
-	 NUMSOLN_TYPE numsoln2);
+checkLUT(const struct lutd lut1[],
+         const struct lutd lut2[]);
 
 // LUTs are initialized to this order at startup.
 static constexpr int lut_initial_d = 8;
-static int lut_valid_d = 0;
+// LUTs are valid up to this order. Tables are only ever added for higher
+// orders, under lut_mutex, and published by a release store, so readers that
+// see lut_valid_d >= d can use LUT[d] without locking.
+static std::atomic<int> lut_valid_d(0);
+static std::mutex lut_mutex;
+// Mapping of the LUT image file the LUTs point into, if any.
+static void *lut_image_map = NULL;
+static size_t lut_image_map_size = 0;
 
 // Use flute LUT file reader.
 #define LUT_FILE 1
@@ -219,56 +643,103 @@ static int lut_valid_d = 0;
 extern std::string post9;
 extern std::string powv9;
 
+static std::string
+readFile(const char *filename) {
+  FILE *fp = fopen(filename, "rb");
+  if (fp == NULL) {
+    printf("Error in opening %s\n", filename);
+    exit(1);
+  }
+  std::string contents;
+  char buf[1 << 16];
+  size_t n;
+  while ((n = fread(buf, 1, sizeof(buf), fp)) > 0)
+    contents.append(buf, n);
+  fclose(fp);
+  return contents;
+}
+
+// Init LUTs of orders from_d..to_d from the LUT files.
+static void
+readLUTfiles(int from_d,
+             int to_d,
+             struct lutd_storage storage[],
+             struct lutd lut[]) {
+  std::string pwv = readFile(FLUTE_POWVFILE);
+#if FLUTE_ROUTING == 1
+  std::string prt = readFile(FLUTE_POSTFILE);
+#else
+  std::string prt;
+#endif
+  parseLUT(pwv.c_str(), prt.c_str(), from_d, to_d, storage, lut);
+}
+
+// Init LUTs of orders from_d..to_d from base64 encoded string variables.
+static void
+initLUT(int from_d,
+        int to_d,
+        struct lutd_storage storage[],
+        struct lutd lut[]) {
+  std::string pwv = base64_decode(powv9);
+#if FLUTE_ROUTING == 1
+  std::string prt = base64_decode(post9);
+#else
+  std::string prt;
+#endif
+  parseLUT(pwv.c_str(), prt.c_str(), from_d, to_d, storage, lut);
+}
+
 void readLUT() {
-  makeLUT(LUT, numsoln);
+  if (lut_valid_d.load(std::memory_order_acquire) > 0)
+    return;
+  std::lock_guard<std::mutex> lock(lut_mutex);
+  if (lut_valid_d.load(std::memory_order_relaxed) > 0)
+    return;
 
 #if LUT_SOURCE==LUT_FILE
-  readLUTfiles(LUT, numsoln);
-  lut_valid_d = FLUTE_D;
+  readLUTfiles(4, FLUTE_D, lut_storage, LUT);
+  lut_valid_d.store(FLUTE_D, std::memory_order_release);
 
 #elif LUT_SOURCE==LUT_VAR
   // Only init to d=8 on startup because d=9 is big and slow.
-  initLUT(lut_initial_d, LUT, numsoln);
+  initLUT(4, lut_initial_d, lut_storage, LUT);
+  lut_valid_d.store(lut_initial_d, std::memory_order_release);
 
 #elif LUT_SOURCE==LUT_VAR_CHECK
-  readLUTfiles(LUT, numsoln);
+  readLUTfiles(4, FLUTE_D, lut_storage, LUT);
   // Temporaries to compare to file results.
-  LUT_TYPE LUT_;
-  NUMSOLN_TYPE numsoln_;
-  makeLUT(LUT_, numsoln_);
-  initLUT(FLUTE_D, LUT_, numsoln_);
-  checkLUT(LUT, numsoln, LUT_, numsoln_);
+  static struct lutd_storage storage_[FLUTE_D + 1];
+  struct lutd LUT_[FLUTE_D + 1];
+  initLUT(4, FLUTE_D, storage_, LUT_);
+  checkLUT(LUT, LUT_);
+  clearLUT(storage_, LUT_);
+  lut_valid_d.store(FLUTE_D, std::memory_order_release);
 #endif
 }
 
-static void
-makeLUT(LUT_TYPE &LUT,
-	NUMSOLN_TYPE &numsoln)
-{
-  LUT = new struct csoln **[FLUTE_D + 1];
-  numsoln = new int*[FLUTE_D + 1];
-  for (int d = 4; d <= FLUTE_D; d++) {
-    LUT[d] = new struct csoln *[MGROUP];
-    numsoln[d] = new int[MGROUP];
-  }
-}
-
 void
 deleteLUT()
 {
-  deleteLUT(LUT, numsoln);
+  std::lock_guard<std::mutex> lock(lut_mutex);
+  if (lut_valid_d.load(std::memory_order_relaxed) == 0)
+    return;
+  clearLUT(lut_storage, LUT);
+  if (lut_image_map != NULL) {
+    munmap(lut_image_map, lut_image_map_size);
+    lut_image_map = NULL;
+    lut_image_map_size = 0;
+  }
+  lut_valid_d.store(0, std::memory_order_release);
 }
 
 static void
-deleteLUT(LUT_TYPE &LUT,
-	  NUMSOLN_TYPE &numsoln)
+clearLUT(struct lutd_storage storage[],
+         struct lutd lut[])
 {
   for (int d = 4; d <= FLUTE_D; d++) {
-    delete [] LUT[d];
-    delete [] numsoln[d];
+    storage[d] = lutd_storage();
+    lut[d] = lutd();
   }
-  delete [] numsoln;
-  delete [] LUT;
 }
 
 static unsigned char
@@ -282,19 +753,16 @@ charNum(unsigned char c)
     return 0;
 }
 
-// Init LUTs from base64 encoded string variables.
+// Parse the LUTs of orders from_d..to_d from the contents of the POWV and
+// POST files into storage[] and point lut[] to them. Tables of lower orders
+// are skipped and left untouched.
 static void
-initLUT(int to_d,
-        LUT_TYPE LUT,
-	NUMSOLN_TYPE numsoln) {
-  std::string pwv_string = base64_decode(powv9);
-  const char *pwv = pwv_string.c_str();
-
-#if FLUTE_ROUTING == 1
-  std::string prt_string = base64_decode(post9);
-  const char *prt = prt_string.c_str();
-#endif
-
+parseLUT(const char *pwv,
+         const char *prt,
+         int from_d,
+         int to_d,
+         struct lutd_storage storage[],
+         struct lutd lut[]) {
   for (int d = 4; d <= to_d; d++) {
     int char_cnt;
     sscanf(pwv, "d=%d%n", &d, &char_cnt);
@@ -303,104 +771,329 @@ initLUT(int to_d,
     sscanf(prt, "d=%d%n", &d, &char_cnt);
     prt += char_cnt + 1;
 #endif
+    struct lutd_storage *st = &storage[d];
+    if (d >= from_d) {
+      *st = lutd_storage();
+      st->first.resize(numgrp[d]);
+      st->numsoln.resize(numgrp[d]);
+    }
     for (int k = 0; k < numgrp[d]; k++) {
       int ns = charNum(*pwv++);
+      if (d < from_d) {  // already loaded, every solution is one line
+	pwv = strchr(pwv, '\n') + 1;
+	for (int i = 1; i <= ns; i++)
+	  pwv = strchr(pwv, '\n') + 1;
+#if FLUTE_ROUTING == 1
+	prt += ns * (2 * d - 2);
+#endif
+	continue;
+      }
       if (ns == 0) {  // same as some previous group
 	int kk;
 	sscanf(pwv, "%d%n", &kk, &char_cnt);
 	pwv += char_cnt + 1;
-	numsoln[d][k] = numsoln[d][kk];
-	LUT[d][k] = LUT[d][kk];
+	st->first[k] = st->first[kk];
+	st->numsoln[k] = st->numsoln[kk];
       } else {
 	pwv++;   // '\n'
-	numsoln[d][k] = ns;
-	struct csoln *p = new struct csoln[ns];
-	LUT[d][k] = p;
+	int nseg = POWV_NSEG(d);
+	int nblock = (ns + POWV_LANES - 1) / POWV_LANES;
+	size_t first = st->post.size();
+	st->first[k] = first;
+	st->numsoln[k] = ns;
+	st->post.resize(first + nblock * POWV_LANES);
+	st->coef.resize((first + nblock * POWV_LANES) * nseg);
+	unsigned char *coef = &st->coef[first * nseg];
+	// Coefficients of POWV i, where POWV 0 is the span alone.
+	int c[MPOWV + 1][POWV_NSEG(FLUTE_D)];
+	memset(c[0], 0, sizeof(c[0]));
 	for (int i = 1; i <= ns; i++) {
-	  p->parent = charNum(*pwv++);
+	  struct csoln p;
+	  memset(&p, 0, sizeof(p));
+	  p.parent = charNum(*pwv++);
 
 	  int j = 0;
 	  unsigned char ch, seg;
 	  do {
 	    ch = *pwv++;
 	    seg = charNum(ch);
-	    p->seg[j++] = seg;
+	    p.seg[j++] = seg;
 	  } while (seg != 0);
 
 	  j = 10;
 	  if (ch == '\n')
-	    p->seg[j] = 0;
+	    p.seg[j] = 0;
 	  else {
 	    do {
 	      ch = *pwv++;
 	      seg = charNum(ch);
-	      p->seg[j--] = seg;
+	      p.seg[j--] = seg;
 	    } while (seg != 0);
 	  }
 
+	  // The first POWV adds to the span, the others derive from a parent.
+	  memcpy(c[i], c[i == 1 ? 0 : p.parent], sizeof(c[i]));
+	  for (j = 0; p.seg[j] != 0; j++)
+	    c[i][powvSegment(d, p.seg[j])]++;
+	  if (i > 1)
+	    for (j = 10; p.seg[j] != 0; j--)
+	      c[i][powvSegment(d, p.seg[j])]--;
+	  unsigned char *block = coef + (i - 1) / POWV_LANES * nseg * POWV_LANES;
+	  for (int s = 0; s < nseg; s++)
+	    block[s * POWV_LANES + (i - 1) % POWV_LANES] = c[i][s];
+
 #if FLUTE_ROUTING == 1
+	  struct cpost *q = &st->post[first + i - 1];
 	  int nn = 2 * d - 2;
 	  for (int j = d; j < nn; j++)
-	    p->rowcol[j - d] = charNum(*prt++);
-
-	  for (int j = 0; j < nn;) {
-	    unsigned char c = *prt++;
-	    p->neighbor[j++] = c / 16;
-	    p->neighbor[j++] = c % 16;
-	  }
+	    q->rowcol[j - d] = charNum(*prt++);
+	  // Neighbors come packed two per byte, as they are kept.
+	  memcpy(q->neighbor, prt, nn / 2);
+	  prt += nn / 2;
 	  prt++;  // \n
 #endif
-	  p++;
 	}
       }
     }
+    if (d >= from_d) {
+      lut[d].first = st->first.data();
+      lut[d].numsoln = st->numsoln.data();
+      lut[d].coef = st->coef.data();
+      lut[d].post = st->post.data();
+    }
   }
-  lut_valid_d = to_d;
 }
 
-static void
+void
 ensureLUT(int d) {
-  if (d > lut_valid_d && d <= FLUTE_D) {
-    initLUT(FLUTE_D, LUT, numsoln);
+  if (d <= lut_valid_d.load(std::memory_order_acquire) || d > FLUTE_D)
+    return;
+  readLUT();
+  std::lock_guard<std::mutex> lock(lut_mutex);
+  int valid_d = lut_valid_d.load(std::memory_order_relaxed);
+  if (d > valid_d) {
+    initLUT(valid_d + 1, FLUTE_D, lut_storage, LUT);
+    lut_valid_d.store(FLUTE_D, std::memory_order_release);
   }
 }
 
 static void
-checkLUT(LUT_TYPE LUT1,
-	 NUMSOLN_TYPE numsoln1,
-	 LUT_TYPE LUT2,
-	 NUMSOLN_TYPE numsoln2) {
+checkLUT(const struct lutd lut1[],
+         const struct lutd lut2[]) {
   for (int d = 4; d <= FLUTE_D; d++) {
     for (int k = 0; k < numgrp[d]; k++) {
-      int ns1 = numsoln1[d][k];
-      int ns2 = numsoln2[d][k];
+      int ns1 = lut1[d].numsoln[k];
+      int ns2 = lut2[d].numsoln[k];
       if (ns1 != ns2)
 	printf("numsoln[%d][%d] mismatch\n", d, k);
-      struct csoln *soln1 = LUT1[d][k];
-      struct csoln *soln2 = LUT2[d][k];
-      if (soln1->parent != soln2->parent)
-	printf("LUT[%d][%d]->parent mismatch\n", d, k);
-      for (int j = 0; soln1->seg[j] != 0; j++) {
-	if (soln1->seg[j] != soln2->seg[j])
-	  printf("LUT[%d][%d]->seg[%d] mismatch\n", d, k, j);
-      }
-      for (int j = 10; soln1->seg[j] != 0; j--) {
-	if (soln1->seg[j] != soln2->seg[j])
-	  printf("LUT[%d][%d]->seg[%d] mismatch\n", d, k, j);
+      const struct cpost *post1 = lut1[d].post + lut1[d].first[k];
+      const struct cpost *post2 = lut2[d].post + lut2[d].first[k];
+      int nseg = POWV_NSEG(d);
+      for (int i = 0; i < ns1 && i < ns2; i++) {
+	const unsigned char *coef1 = lut1[d].coef
+	  + (lut1[d].first[k] + i) / POWV_LANES * nseg * POWV_LANES;
+	const unsigned char *coef2 = lut2[d].coef
+	  + (lut2[d].first[k] + i) / POWV_LANES * nseg * POWV_LANES;
+	for (int s = 0; s < nseg; s++) {
+	  if (coef1[s * POWV_LANES + i % POWV_LANES]
+	      != coef2[s * POWV_LANES + i % POWV_LANES])
+	    printf("LUT[%d][%d] POWV %d coef[%d] mismatch\n", d, k, i, s);
+	}
       }
       int nn = 2 * d - 2;
       for (int j = d; j < nn; j++) {
-	if (soln1->rowcol[j - d] != soln2->rowcol[j - d])
+	if (post1->rowcol[j - d] != post2->rowcol[j - d])
 	  printf("LUT[%d][%d]->rowcol[%d] mismatch\n", d, k, j);
       }
       for (int j = 0; j < nn; j++) {
-	if (soln1->neighbor[j] != soln2->neighbor[j])
+	if (postNeighbor(post1, j) != postNeighbor(post2, j))
 	  printf("LUT[%d][%d]->neighbor[%d] mismatch\n", d, k, j);
       }
     }
   }
 }
 
+////////////////////////////////////////////////////////////////
+
+// Precompiled LUT image.
+// The image holds the flattened LUTs of every order, laid out as in memory
+// but with offsets in bytes from the start of the image instead of pointers,
+// so that it can be mapped from a file, or compiled into the binary, and used
+// in place. For each order d the image has:
+//   uint32_t first[numgrp[d]];   // first POWV of group k
+//   uint8_t numsoln[numgrp[d]];  // number of POWVs of group k
+//   uint8_t coef[nsoln * POWV_NSEG(d)];  // coefficient blocks of the POWVs
+//   struct cpost post[nsoln];    // Steiner trees of the POWVs
+// where nsoln, the number of POWVs with padding, is a multiple of POWV_LANES.
+static const char lut_image_magic[8] = {'F', 'L', 'U', 'T', 'E', 'L', 'U', 'T'};
+static constexpr uint32_t lut_image_version = 3;
+static constexpr uint32_t lut_image_byte_order = 0x01020304;
+
+struct lut_image_degree {
+        uint64_t first_offset;
+        uint64_t numsoln_offset;
+        uint64_t coef_offset;
+        uint64_t post_offset;
+        uint32_t ngroup;
+        uint32_t nsoln;
+};
+
+struct lut_image_header {
+        char magic[8];
+        uint32_t version;
+        uint32_t byte_order;
+        uint32_t flute_d;
+        uint32_t routing;
+        uint32_t powv_lanes;
+        uint32_t post_size;
+        uint64_t size;
+        struct lut_image_degree degree[FLUTE_D + 1];  // 4 .. FLUTE_D
+};
+
+static size_t
+alignImageOffset(size_t offset) {
+  return (offset + 7) & ~(size_t)7;
+}
+
+static bool
+checkLUTImage(const unsigned char *image,
+              size_t size) {
+  const struct lut_image_header *header =
+    (const struct lut_image_header *)image;
+  if (size < sizeof(struct lut_image_header)
+      || memcmp(header->magic, lut_image_magic, sizeof(lut_image_magic)) != 0
+      || header->version != lut_image_version
+      || header->byte_order != lut_image_byte_order
+      || header->flute_d != FLUTE_D
+      || header->routing != FLUTE_ROUTING
+      || header->powv_lanes != POWV_LANES
+      || header->post_size != sizeof(struct cpost)
+      || header->size != size)
+    return false;
+
+  for (int d = 4; d <= FLUTE_D; d++) {
+    const struct lut_image_degree *deg = &header->degree[d];
+    if (deg->ngroup != (uint32_t)numgrp[d]
+        || deg->first_offset % alignof(uint32_t) != 0
+        || deg->first_offset + deg->ngroup * sizeof(uint32_t) > size
+        || deg->numsoln_offset + deg->ngroup > size
+        || deg->nsoln % POWV_LANES != 0
+        || deg->coef_offset + (uint64_t)deg->nsoln * POWV_NSEG(d) > size
+        || deg->post_offset + (uint64_t)deg->nsoln * sizeof(struct cpost) > size)
+      return false;
+    const uint32_t *first = (const uint32_t *)(image + deg->first_offset);
+    const unsigned char *ns = image + deg->numsoln_offset;
+    for (uint32_t k = 0; k < deg->ngroup; k++) {
+      if (ns[k] == 0 || ns[k] > MPOWV || first[k] % POWV_LANES != 0
+          || (uint64_t)first[k] + ns[k] > deg->nsoln)
+        return false;
+    }
+  }
+  return true;
+}
+
+bool useLUTImage(const void *image,
+                 size_t size) {
+  std::lock_guard<std::mutex> lock(lut_mutex);
+  if (lut_valid_d.load(std::memory_order_relaxed) > 0)
+    return false;
+
+  const unsigned char *base = (const unsigned char *)image;
+  if (!checkLUTImage(base, size)) {
+    fprintf(stderr, "Invalid FLUTE LUT image\n");
+    return false;
+  }
+
+  const struct lut_image_header *header =
+    (const struct lut_image_header *)base;
+  for (int d = 4; d <= FLUTE_D; d++) {
+    const struct lut_image_degree *deg = &header->degree[d];
+    LUT[d].first = (const uint32_t *)(base + deg->first_offset);
+    LUT[d].numsoln = base + deg->numsoln_offset;
+    LUT[d].coef = base + deg->coef_offset;
+    LUT[d].post = (const struct cpost *)(base + deg->post_offset);
+  }
+  lut_valid_d.store(FLUTE_D, std::memory_order_release);
+  return true;
+}
+
+bool readLUTImage(const char *filename) {
+  int fd = open(filename, O_RDONLY);
+  if (fd < 0)
+    return false;
+  struct stat st;
+  void *map = MAP_FAILED;
+  if (fstat(fd, &st) == 0 && st.st_size > 0)
+    map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED)
+    return false;
+
+  if (!useLUTImage(map, st.st_size)) {
+    munmap(map, st.st_size);
+    return false;
+  }
+  lut_image_map = map;
+  lut_image_map_size = st.st_size;
+  return true;
+}
+
+bool writeLUTImage(const char *filename) {
+  ensureLUT(FLUTE_D);
+
+  // Lay out the sections.
+  struct lut_image_header header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, lut_image_magic, sizeof(lut_image_magic));
+  header.version = lut_image_version;
+  header.byte_order = lut_image_byte_order;
+  header.flute_d = FLUTE_D;
+  header.routing = FLUTE_ROUTING;
+  header.powv_lanes = POWV_LANES;
+  header.post_size = sizeof(struct cpost);
+
+  size_t offset = alignImageOffset(sizeof(header));
+  for (int d = 4; d <= FLUTE_D; d++) {
+    struct lut_image_degree *deg = &header.degree[d];
+    uint32_t nsoln = 0;
+    for (int k = 0; k < numgrp[d]; k++)
+      nsoln = std::max(nsoln, LUT[d].first[k] + LUT[d].numsoln[k]);
+    nsoln = (nsoln + POWV_LANES - 1) / POWV_LANES * POWV_LANES;
+    deg->ngroup = numgrp[d];
+    deg->nsoln = nsoln;
+    deg->first_offset = offset;
+    offset = alignImageOffset(offset + numgrp[d] * sizeof(uint32_t));
+    deg->numsoln_offset = offset;
+    offset = alignImageOffset(offset + numgrp[d]);
+    deg->coef_offset = offset;
+    offset = alignImageOffset(offset + nsoln * POWV_NSEG(d));
+    deg->post_offset = offset;
+    offset = alignImageOffset(offset + nsoln * sizeof(struct cpost));
+  }
+  header.size = offset;
+
+  std::vector<unsigned char> image(header.size, 0);
+  memcpy(image.data(), &header, sizeof(header));
+  for (int d = 4; d <= FLUTE_D; d++) {
+    const struct lut_image_degree *deg = &header.degree[d];
+    memcpy(image.data() + deg->first_offset, LUT[d].first,
+           numgrp[d] * sizeof(uint32_t));
+    memcpy(image.data() + deg->numsoln_offset, LUT[d].numsoln, numgrp[d]);
+    memcpy(image.data() + deg->coef_offset, LUT[d].coef,
+           deg->nsoln * POWV_NSEG(d));
+    memcpy(image.data() + deg->post_offset, LUT[d].post,
+           deg->nsoln * sizeof(struct cpost));
+  }
+
+  FILE *fp = fopen(filename, "wb");
+  if (fp == NULL) {
+    fprintf(stderr, "Error in opening %s\n", filename);
+    return false;
+  }
+  bool ok = fwrite(image.data(), 1, image.size(), fp) == image.size();
+  return fclose(fp) == 0 && ok;
+}
+
 /* 
    base64.cpp and base64.h
 
@@ -482,21 +1175,148 @@ base64_decode(std::string const& encoded_string) {
 
 ////////////////////////////////////////////////////////////////
 
+// Pin sorting.
+// Nets up to this degree are sorted by a sorting network, larger ones by an
+// LSD radix sort on the coordinates, which is linear as they span a bounded
+// range.
+#define SORT_NETWORK_D 16
+#define RADIX_BITS 8
+
+// Sets out[] to in[] stably sorted by key[in[i]]. tmp[] is scratch of the
+// same size.
+static void
+sortByKey(int d, const DTYPE key[], const int in[], int out[], int tmp[]) {
+  if (d <= SORT_NETWORK_D) {
+    // Make the keys unique by appending the position so that the network,
+    // which is not stable by itself, gives the stable order.
+    uint64_t k[SORT_NETWORK_D];
+    for (int i = 0; i < d; i++)
+      k[i] = (uint64_t)((uint32_t)key[in[i]] ^ 0x80000000u) << 32 | (uint32_t)i;
+    // Odd-even transposition network, branch-free compare-exchanges.
+    for (int round = 0; round < d; round++) {
+      for (int i = round % 2; i + 1 < d; i += 2) {
+        uint64_t lo = std::min(k[i], k[i + 1]);
+        uint64_t hi = std::max(k[i], k[i + 1]);
+        k[i] = lo;
+        k[i + 1] = hi;
+      }
+    }
+    for (int i = 0; i < d; i++)
+      out[i] = in[(uint32_t)k[i]];
+    return;
+  }
+
+  DTYPE lo = key[in[0]], hi = key[in[0]];
+  for (int i = 1; i < d; i++) {
+    lo = std::min(lo, key[in[i]]);
+    hi = std::max(hi, key[in[i]]);
+  }
+  uint32_t range = (uint32_t)hi - (uint32_t)lo;
+  int passes = 1;
+  while (passes * RADIX_BITS < 32 && (range >> (passes * RADIX_BITS)) != 0)
+    passes++;
+
+  // Ping-pong between out[] and tmp[], ending in out[].
+  const int *src = in;
+  int *dst = (passes % 2 == 1) ? out : tmp;
+  for (int pass = 0; pass < passes; pass++) {
+    int shift = pass * RADIX_BITS;
+    int count[(1 << RADIX_BITS) + 1] = {0};
+    for (int i = 0; i < d; i++)
+      count[(((uint32_t)key[src[i]] - (uint32_t)lo) >> shift
+             & ((1 << RADIX_BITS) - 1)) + 1]++;
+    for (int b = 0; b < (1 << RADIX_BITS); b++)
+      count[b + 1] += count[b];
+    for (int i = 0; i < d; i++)
+      dst[count[((uint32_t)key[src[i]] - (uint32_t)lo) >> shift
+                & ((1 << RADIX_BITS) - 1)]++] = src[i];
+    src = dst;
+    dst = (dst == out) ? tmp : out;
+  }
+}
+
+// Sorts the pins (x[i], y[i]) into xs[] and ys[] and sets s[] as flutes()
+// takes them. Pins tied in x keep their input order and pins tied in y are
+// ordered by x.
+static void
+sortPins(int d, const DTYPE x[], const DTYPE y[],
+         DTYPE xs[], DTYPE ys[], int s[]) {
+  int *pins = (int *)fluteAlloc(sizeof(int) * d);
+  int *byx = (int *)fluteAlloc(sizeof(int) * d);
+  int *byy = (int *)fluteAlloc(sizeof(int) * d);
+  int *rank = (int *)fluteAlloc(sizeof(int) * d);
+
+  for (int i = 0; i < d; i++)
+    pins[i] = i;
+  sortByKey(d, x, pins, byx, rank);
+  sortByKey(d, y, byx, byy, rank);
+
+  for (int i = 0; i < d; i++) {
+    xs[i] = x[byx[i]];
+    rank[byx[i]] = i;
+  }
+  for (int i = 0; i < d; i++) {
+    ys[i] = y[byy[i]];
+    s[i] = rank[byy[i]];
+  }
+
+  fluteFree(pins);
+  fluteFree(byx);
+  fluteFree(byy);
+  fluteFree(rank);
+}
+
+////////////////////////////////////////////////////////////////
+
+// Branch and bound.
+// Any tree of a net is at least as long as the half-perimeter of its pins,
+// and so is the length that FLUTE returns for it: the lengths of the LUT are
+// the span of the net plus nonnegative segment lengths, and the length of a
+// merged tree is that of its branches. A breaking is dropped as soon as the
+// bound on its length, with the subtrees that are not solved yet counted at
+// their half-perimeter, reaches the best length so far, which a breaking has
+// to be shorter than to be taken.
+
+static thread_local BreakingStats breaking_stats = {0, 0};
+
+BreakingStats breakingStats() {
+  return breaking_stats;
+}
+
+void resetBreakingStats() {
+  breaking_stats.solved = breaking_stats.pruned = 0;
+}
+
+// Returns the half-perimeter of the d pins of sorted coords xs[] and ys[].
+static inline DTYPE
+halfPerimeter(int d, const DTYPE xs[], const DTYPE ys[]) {
+  return xs[d - 1] - xs[0] + ys[d - 1] - ys[0];
+}
+
+// Returns a bound on what flutes_MD() saves when it merges the subtrees of
+// a breaking at the pin they share: along the coordinate across the
+// breaking, at most the distance from the pin, at pin, to its neighbor in
+// the first subtree, at coord1, and to the far side of the second subtree,
+// which spans lo2..hi2.
+static inline DTYPE
+mergeSavingBound(DTYPE pin, DTYPE coord1, DTYPE lo2, DTYPE hi2) {
+  if (pin > coord1)
+    return std::min(pin - coord1, pin - lo2);
+  if (pin < coord1)
+    return std::min(coord1 - pin, hi2 - pin);
+  return 0;
+}
+
 DTYPE flute_wl(int d, DTYPE x[], DTYPE y[], int acc) {
-        DTYPE minval, l, xu, xl, yu, yl;
+        DTYPE l, xu, xl, yu, yl;
         DTYPE *xs, *ys;
-        int i, j, minidx, degree;
         int *s;
-        struct point **ptp, *tmpp;
-        struct point *pt;
-        
-        /* allocate the dynamic pieces on the heap rather than the stack */
-        degree = d + 1;
-        xs = (DTYPE *)malloc(sizeof(DTYPE) * (d));
-        ys = (DTYPE *)malloc(sizeof(DTYPE) * (d));
-        s = (int *)malloc(sizeof(int) * (d));
-        pt = (struct point *)malloc(sizeof(struct point) * (d+1));
-        ptp = (struct point **)malloc(sizeof(struct point *) * (d+1));
+        struct arena_scope scope;  // releases the pieces below on return
+
+        /* allocate the dynamic pieces in the arena rather than the stack */
+        xs = (DTYPE *)fluteAlloc(sizeof(DTYPE) * (d));
+        ys = (DTYPE *)fluteAlloc(sizeof(DTYPE) * (d));
+        s = (int *)fluteAlloc(sizeof(int) * (d));
 
         if (d == 2)
                 l = ADIFF(x[0], x[1]) + ADIFF(y[0], y[1]);
@@ -518,71 +1338,13 @@ DTYPE flute_wl(int d, DTYPE x[], DTYPE y[], int acc) {
                 l = (xu - xl) + (yu - yl);
         } else {
                 ensureLUT(d);
-                
-                for (i = 0; i < d; i++) {
-                        pt[i].x = x[i];
-                        pt[i].y = y[i];
-                        ptp[i] = &pt[i];
-                }
-
-                // sort x
-                for (i = 0; i < d - 1; i++) {
-                        minval = ptp[i]->x;
-                        minidx = i;
-                        for (j = i + 1; j < d; j++) {
-                                if (minval > ptp[j]->x) {
-                                        minval = ptp[j]->x;
-                                        minidx = j;
-                                }
-                        }
-                        tmpp = ptp[i];
-                        ptp[i] = ptp[minidx];
-                        ptp[minidx] = tmpp;
-                }
-
-#if FLUTE_REMOVE_DUPLICATE_PIN == 1
-                ptp[d] = &pt[d];
-                ptp[d]->x = ptp[d]->y = -999999;
-                j = 0;
-                for (i = 0; i < d; i++) {
-                        for (k = i + 1; ptp[k]->x == ptp[i]->x; k++)
-                                if (ptp[k]->y == ptp[i]->y)  // pins k and i are the same
-                                        break;
-                        if (ptp[k]->x != ptp[i]->x)
-                                ptp[j++] = ptp[i];
-                }
-                d = j;
-#endif
 
-                for (i = 0; i < d; i++) {
-                        xs[i] = ptp[i]->x;
-                        ptp[i]->o = i;
-                }
-
-                // sort y to find s[]
-                for (i = 0; i < d - 1; i++) {
-                        minval = ptp[i]->y;
-                        minidx = i;
-                        for (j = i + 1; j < d; j++) {
-                                if (minval > ptp[j]->y) {
-                                        minval = ptp[j]->y;
-                                        minidx = j;
-                                }
-                        }
-                        ys[i] = ptp[minidx]->y;
-                        s[i] = ptp[minidx]->o;
-                        ptp[minidx] = ptp[i];
-                }
-                ys[d - 1] = ptp[d - 1]->y;
-                s[d - 1] = ptp[d - 1]->o;
+                // Duplicate pins, if FLUTE_REMOVE_DUPLICATE_PIN, are removed
+                // by flutes_wl_RDP().
+                sortPins(d, x, y, xs, ys, s);
 
                 l = flutes_wl(d, xs, ys, s, acc);
         }
-        free( xs ) ;
-        free( ys ) ;
-        free( s ) ;
-        free( pt ) ;
-        free( ptp ) ;
 
         return l;
 }
@@ -624,89 +1386,53 @@ DTYPE flutes_wl_RDP(int d, DTYPE xs[], DTYPE ys[], int s[], int acc) {
 
 // For low-degree, i.e., 2 <= d <= FLUTE_D
 DTYPE flutes_wl_LD(int d, DTYPE xs[], DTYPE ys[], int s[]) {
-        int k, pi, i, j;
-        struct csoln *rlist;
-        DTYPE dd[2 * FLUTE_D - 2];  // 0..FLUTE_D-2 for v, FLUTE_D-1..2*D-3 for h
-        DTYPE minl, sum, l[MPOWV + 1];
-
         if (d <= 3)
-                minl = xs[d - 1] - xs[0] + ys[d - 1] - ys[0];
-        else {
-                ensureLUT(d);
-                               
-                k = 0;
-                if (s[0] < s[2]) k++;
-                if (s[1] < s[2]) k++;
-
-                for (i = 3; i <= d - 1; i++) {  // p0=0 always, skip i=1 for symmetry
-                        pi = s[i];
-                        for (j = d - 1; j > i; j--)
-                                if (s[j] < s[i])
-                                        pi--;
-                        k = pi + (i + 1) * k;
-                }
+                return xs[d - 1] - xs[0] + ys[d - 1] - ys[0];
 
-                if (k < numgrp[d])  // no horizontal flip
-                        for (i = 1; i <= d - 3; i++) {
-                                dd[i] = ys[i + 1] - ys[i];
-                                dd[d - 1 + i] = xs[i + 1] - xs[i];
-                        }
-                else {
-                        k = 2 * numgrp[d] - 1 - k;
-                        for (i = 1; i <= d - 3; i++) {
-                                dd[i] = ys[i + 1] - ys[i];
-                                dd[d - 1 + i] = xs[d - 1 - i] - xs[d - 2 - i];
-                        }
-                }
-
-                minl = l[0] = xs[d - 1] - xs[0] + ys[d - 1] - ys[0];
-                rlist = LUT[d][k];
-                for (i = 0; rlist->seg[i] > 0; i++)
-                        minl += dd[rlist->seg[i]];
-
-                l[1] = minl;
-                j = 2;
-                while (j <= numsoln[d][k]) {
-                        rlist++;
-                        sum = l[rlist->parent];
-                        for (i = 0; rlist->seg[i] > 0; i++)
-                                sum += dd[rlist->seg[i]];
-                        for (i = 10; rlist->seg[i] > 0; i--)
-                                sum -= dd[rlist->seg[i]];
-                        minl = std::min(minl, sum);
-                        l[j++] = sum;
-                }
-        }
-
-        return minl;
+        ensureLUT(d);
+        return wlKernelsLD[d](xs, ys, s);
 }
 
 // For medium-degree, i.e., FLUTE_D+1 <= d
+// Answers the subproblem from the memo if it is there, or solves it with
+// solveWlMD() and adds it.
 DTYPE flutes_wl_MD(int d, DTYPE xs[], DTYPE ys[], int s[], int acc) {
+        uint64_t key = memoKey(d, xs, ys, s, acc, false);
+        const struct memo_entry *entry = findMemo(key, d, xs, ys, s, acc, false);
+        if (entry != NULL)
+                return entry->length;
+        DTYPE l = solveWlMD(d, xs, ys, s, acc);
+        addMemo(key, d, xs, ys, s, acc, NULL, l);
+        return l;
+}
+
+static DTYPE
+solveWlMD(int d, DTYPE xs[], DTYPE ys[], int s[], int acc) {
         float pnlty, dx, dy;
         float *score, *penalty;
         DTYPE xydiff;
-        DTYPE ll, minl, extral;
+        DTYPE ll, minl, extral, hp2;
         DTYPE *x1, *x2, *y1, *y2;
         DTYPE *distx, *disty;
         int i, r, p, maxbp, nbp, bp, ub, lb, n1, n2, newacc;
         int ms, mins, maxs, minsi, maxsi, degree;
         int return_val;
         int *si, *s1, *s2;
+        struct arena_mark mark = arenaMark();
         
         degree = d + 1;
-        score = (float *)malloc(sizeof(float) * (2 * degree));
-        penalty = (float *)malloc(sizeof(float) * (degree));
+        score = (float *)fluteAlloc(sizeof(float) * (2 * degree));
+        penalty = (float *)fluteAlloc(sizeof(float) * (degree));
         
-        x1 = (DTYPE *)malloc(sizeof(DTYPE) * (degree));
-        x2 = (DTYPE *)malloc(sizeof(DTYPE) * (degree));
-        y1 = (DTYPE *)malloc(sizeof(DTYPE) * (degree));
-        y2 = (DTYPE *)malloc(sizeof(DTYPE) * (degree));
-        distx = (DTYPE *)malloc(sizeof(DTYPE) * (degree));
-        disty = (DTYPE *)malloc(sizeof(DTYPE) * (degree));
-        si = (int *)malloc(sizeof(int) * (degree));
-        s1 = (int *)malloc(sizeof(int) * (degree));
-        s2 = (int *)malloc(sizeof(int) * (degree));
+        x1 = (DTYPE *)fluteAlloc(sizeof(DTYPE) * (degree));
+        x2 = (DTYPE *)fluteAlloc(sizeof(DTYPE) * (degree));
+        y1 = (DTYPE *)fluteAlloc(sizeof(DTYPE) * (degree));
+        y2 = (DTYPE *)fluteAlloc(sizeof(DTYPE) * (degree));
+        distx = (DTYPE *)fluteAlloc(sizeof(DTYPE) * (degree));
+        disty = (DTYPE *)fluteAlloc(sizeof(DTYPE) * (degree));
+        si = (int *)fluteAlloc(sizeof(int) * (degree));
+        s1 = (int *)fluteAlloc(sizeof(int) * (degree));
+        s2 = (int *)fluteAlloc(sizeof(int) * (degree));
 
         ensureLUT(d);
 
@@ -730,17 +1456,19 @@ DTYPE flutes_wl_MD(int d, DTYPE xs[], DTYPE ys[], int s[], int acc) {
 
                         return_val = flutes_wl_LMD(ms + 2, x1, y1, s1, acc) +
                                      flutes_wl_LMD(d - ms, xs + ms, ys + ms, s2, acc);
-                        free(score);
-                        free(penalty);
-                        free(x1);
-                        free(x2);
-                        free(y1);
-                        free(y2);
-                        free(distx);
-                        free(disty);
-                        free(si);
-                        free(s1);
-                        free(s2);
+                        breaking_stats.solved += 2;
+                        fluteFree(score);
+                        fluteFree(penalty);
+                        fluteFree(x1);
+                        fluteFree(x2);
+                        fluteFree(y1);
+                        fluteFree(y2);
+                        fluteFree(distx);
+                        fluteFree(disty);
+                        fluteFree(si);
+                        fluteFree(s1);
+                        fluteFree(s2);
+                        arenaRelease(mark);
                         
                         return return_val;
                 }
@@ -767,17 +1495,19 @@ DTYPE flutes_wl_MD(int d, DTYPE xs[], DTYPE ys[], int s[], int acc) {
 
                         return_val = flutes_wl_LMD(d + 1 - ms, x1, y1, s1, acc) +
                                 flutes_wl_LMD(ms + 1, xs, ys + d - 1 - ms, s2, acc);
-                        free(score);
-                        free(penalty);
-                        free(x1);
-                        free(x2);
-                        free(y1);
-                        free(y2);
-                        free(distx);
-                        free(disty);
-                        free(si);
-                        free(s1);
-                        free(s2);
+                        breaking_stats.solved += 2;
+                        fluteFree(score);
+                        fluteFree(penalty);
+                        fluteFree(x1);
+                        fluteFree(x2);
+                        fluteFree(y1);
+                        fluteFree(y2);
+                        fluteFree(distx);
+                        fluteFree(disty);
+                        fluteFree(si);
+                        fluteFree(s1);
+                        fluteFree(s2);
+                        arenaRelease(mark);
                         return return_val;
                 }
         }
@@ -916,8 +1646,21 @@ DTYPE flutes_wl_MD(int d, DTYPE xs[], DTYPE ys[], int s[], int acc) {
                                         n2++;
                                 }
                         }
-                        ll = extral + flutes_wl_LMD(p + 1, xs, y1, s1, newacc) +
-                                flutes_wl_LMD(d - p, xs + p, y2, s2, newacc);
+                        ll = extral + halfPerimeter(p + 1, xs, y1);
+                        hp2 = halfPerimeter(d - p, xs + p, y2);
+                        if (ll + hp2 >= minl) {
+                                breaking_stats.pruned += 2;
+                                continue;
+                        }
+                        ll += flutes_wl_LMD(p + 1, xs, y1, s1, newacc)
+                                - halfPerimeter(p + 1, xs, y1);
+                        breaking_stats.solved++;
+                        if (ll + hp2 >= minl) {
+                                breaking_stats.pruned++;
+                                continue;
+                        }
+                        ll += flutes_wl_LMD(d - p, xs + p, y2, s2, newacc);
+                        breaking_stats.solved++;
                 } else {  // if (!BreakInX(maxbp))
                         n1 = n2 = 0;
                         for (r = 0; r < d; r++) {
@@ -947,54 +1690,44 @@ DTYPE flutes_wl_MD(int d, DTYPE xs[], DTYPE ys[], int s[], int acc) {
                                         n2++;
                                 }
                         }
-                        ll = extral + flutes_wl_LMD(p + 1, x1, ys, s1, newacc) +
-                                flutes_wl_LMD(d - p, x2, ys + p, s2, newacc);
+                        ll = extral + halfPerimeter(p + 1, x1, ys);
+                        hp2 = halfPerimeter(d - p, x2, ys + p);
+                        if (ll + hp2 >= minl) {
+                                breaking_stats.pruned += 2;
+                                continue;
+                        }
+                        ll += flutes_wl_LMD(p + 1, x1, ys, s1, newacc)
+                                - halfPerimeter(p + 1, x1, ys);
+                        breaking_stats.solved++;
+                        if (ll + hp2 >= minl) {
+                                breaking_stats.pruned++;
+                                continue;
+                        }
+                        ll += flutes_wl_LMD(d - p, x2, ys + p, s2, newacc);
+                        breaking_stats.solved++;
                 }
                 if (minl > ll) minl = ll;
         }
         return_val = minl;
         
-        free(score);
-        free(penalty);
-        free(x1);
-        free(x2);
-        free(y1);
-        free(y2);
-        free(distx);
-        free(disty);
-        free(si);
-        free(s1);
-        free(s2);
+        fluteFree(score);
+        fluteFree(penalty);
+        fluteFree(x1);
+        fluteFree(x2);
+        fluteFree(y1);
+        fluteFree(y2);
+        fluteFree(distx);
+        fluteFree(disty);
+        fluteFree(si);
+        fluteFree(s1);
+        fluteFree(s2);
+        arenaRelease(mark);
         return return_val;
 }
 
-static int orderx(const void *a, const void *b) {
-        struct point *pa, *pb;
-
-        pa = *(struct point **)a;
-        pb = *(struct point **)b;
-
-        if (pa->x < pb->x) return -1;
-        if (pa->x > pb->x) return 1;
-        return 0;
-}
-
-static int ordery(const void *a, const void *b) {
-        struct point *pa, *pb;
-
-        pa = *(struct point **)a;
-        pb = *(struct point **)b;
-
-        if (pa->y < pb->y) return -1;
-        if (pa->y > pb->y) return 1;
-        return 0;
-}
-
 Tree flute(int d, DTYPE x[], DTYPE y[], int acc) {
-        DTYPE *xs, *ys, minval;
+        DTYPE *xs, *ys;
         int *s;
-        int i, j, minidx;
-        struct point *pt, **ptp, *tmpp;
         Tree t;
 
         if (d == 2) {
@@ -1008,90 +1741,25 @@ Tree flute(int d, DTYPE x[], DTYPE y[], int acc) {
                 t.branch[1].y = y[1];
                 t.branch[1].n = 1;
         } else {
+                // Work in the arena, released on return.
+                struct arena_scope scope;
+
                 ensureLUT(d);
                 
-                xs = (DTYPE *)malloc(sizeof(DTYPE) * (d));
-                ys = (DTYPE *)malloc(sizeof(DTYPE) * (d));
-                s = (int *)malloc(sizeof(int) * (d));
-                pt = (struct point *)malloc(sizeof(struct point) * (d + 1));
-                ptp = (struct point **)malloc(sizeof(struct point *) * (d + 1));
-
-                for (i = 0; i < d; i++) {
-                        pt[i].x = x[i];
-                        pt[i].y = y[i];
-                        ptp[i] = &pt[i];
-                }
+                xs = (DTYPE *)fluteAlloc(sizeof(DTYPE) * (d));
+                ys = (DTYPE *)fluteAlloc(sizeof(DTYPE) * (d));
+                s = (int *)fluteAlloc(sizeof(int) * (d));
 
-                // sort x
-                if (d < 200) {
-                        for (i = 0; i < d - 1; i++) {
-                                minval = ptp[i]->x;
-                                minidx = i;
-                                for (j = i + 1; j < d; j++) {
-                                        if (minval > ptp[j]->x) {
-                                                minval = ptp[j]->x;
-                                                minidx = j;
-                                        }
-                                }
-                                tmpp = ptp[i];
-                                ptp[i] = ptp[minidx];
-                                ptp[minidx] = tmpp;
-                        }
-                } else {
-                        qsort(ptp, d, sizeof(struct point *), orderx);
-                }
-
-#if FLUTE_REMOVE_DUPLICATE_PIN == 1
-                ptp[d] = &pt[d];
-                ptp[d]->x = ptp[d]->y = -999999;
-                j = 0;
-                for (i = 0; i < d; i++) {
-                        for (k = i + 1; ptp[k]->x == ptp[i]->x; k++)
-                                if (ptp[k]->y == ptp[i]->y)  // pins k and i are the same
-                                        break;
-                        if (ptp[k]->x != ptp[i]->x)
-                                ptp[j++] = ptp[i];
-                }
-                d = j;
-#endif
-
-                for (i = 0; i < d; i++) {
-                        xs[i] = ptp[i]->x;
-                        ptp[i]->o = i;
-                }
-
-                // sort y to find s[]
-                if (d < 200) {
-                        for (i = 0; i < d - 1; i++) {
-                                minval = ptp[i]->y;
-                                minidx = i;
-                                for (j = i + 1; j < d; j++) {
-                                        if (minval > ptp[j]->y) {
-                                                minval = ptp[j]->y;
-                                                minidx = j;
-                                        }
-                                }
-                                ys[i] = ptp[minidx]->y;
-                                s[i] = ptp[minidx]->o;
-                                ptp[minidx] = ptp[i];
-                        }
-                        ys[d - 1] = ptp[d - 1]->y;
-                        s[d - 1] = ptp[d - 1]->o;
-                } else {
-                        qsort(ptp, d, sizeof(struct point *), ordery);
-                        for (i = 0; i < d; i++) {
-                                ys[i] = ptp[i]->y;
-                                s[i] = ptp[i]->o;
-                        }
-                }
+                // Duplicate pins, if FLUTE_REMOVE_DUPLICATE_PIN, are removed
+                // by flutes_RDP().
+                sortPins(d, x, y, xs, ys, s);
 
                 t = flutes(d, xs, ys, s, acc);
 
-                free(xs);
-                free(ys);
-                free(s);
-                free(pt);
-                free(ptp);
+                // The caller frees the result with free_tree().
+                Branch *branch = (Branch *)malloc((2 * t.deg - 2) * sizeof(Branch));
+                memcpy(branch, t.branch, (2 * t.deg - 2) * sizeof(Branch));
+                t.branch = branch;
         }
 
         return t;
@@ -1134,17 +1802,12 @@ Tree flutes_RDP(int d, DTYPE xs[], DTYPE ys[], int s[], int acc) {
 
 // For low-degree, i.e., 2 <= d <= FLUTE_D
 Tree flutes_LD(int d, DTYPE xs[], DTYPE ys[], int s[]) {
-        int k, pi, i, j;
-        struct csoln *rlist, *bestrlist;
-        DTYPE dd[2 * FLUTE_D - 2];  // 0..D-2 for v, D-1..2*D-3 for h
-        DTYPE minl, sum, l[MPOWV + 1];
-        int hflip;
         Tree t;
 
         t.deg = d;
-        t.branch = (Branch *)malloc((2 * d - 2) * sizeof(Branch));
+        t.branch = (Branch *)fluteAlloc((2 * d - 2) * sizeof(Branch));
         if (d == 2) {
-                minl = xs[1] - xs[0] + ys[1] - ys[0];
+                t.length = xs[1] - xs[0] + ys[1] - ys[0];
                 t.branch[0].x = xs[s[0]];
                 t.branch[0].y = ys[0];
                 t.branch[0].n = 1;
@@ -1152,7 +1815,7 @@ Tree flutes_LD(int d, DTYPE xs[], DTYPE ys[], int s[]) {
                 t.branch[1].y = ys[1];
                 t.branch[1].n = 1;
         } else if (d == 3) {
-                minl = xs[2] - xs[0] + ys[2] - ys[0];
+                t.length = xs[2] - xs[0] + ys[2] - ys[0];
                 t.branch[0].x = xs[s[0]];
                 t.branch[0].y = ys[0];
                 t.branch[0].n = 3;
@@ -1167,118 +1830,146 @@ Tree flutes_LD(int d, DTYPE xs[], DTYPE ys[], int s[]) {
                 t.branch[3].n = 3;
         } else {
                 ensureLUT(d);
-                
-                k = 0;
-                if (s[0] < s[2]) k++;
-                if (s[1] < s[2]) k++;
-
-                for (i = 3; i <= d - 1; i++) {  // p0=0 always, skip i=1 for symmetry
-                        pi = s[i];
-                        for (j = d - 1; j > i; j--)
-                                if (s[j] < s[i])
-                                        pi--;
-                        k = pi + (i + 1) * k;
-                }
+                t.length = treeKernelsLD[d](xs, ys, s, t.branch);
+        }
 
-                if (k < numgrp[d]) {  // no horizontal flip
-                        hflip = 0;
-                        for (i = 1; i <= d - 3; i++) {
-                                dd[i] = ys[i + 1] - ys[i];
-                                dd[d - 1 + i] = xs[i + 1] - xs[i];
-                        }
-                } else {
-                        hflip = 1;
-                        k = 2 * numgrp[d] - 1 - k;
-                        for (i = 1; i <= d - 3; i++) {
-                                dd[i] = ys[i + 1] - ys[i];
-                                dd[d - 1 + i] = xs[d - 1 - i] - xs[d - 2 - i];
-                        }
-                }
+        return t;
+}
 
-                minl = l[0] = xs[d - 1] - xs[0] + ys[d - 1] - ys[0];
-                rlist = LUT[d][k];
-                for (i = 0; rlist->seg[i] > 0; i++)
-                        minl += dd[rlist->seg[i]];
-                bestrlist = rlist;
-                l[1] = minl;
-                j = 2;
-                while (j <= numsoln[d][k]) {
-                        rlist++;
-                        sum = l[rlist->parent];
-                        for (i = 0; rlist->seg[i] > 0; i++)
-                                sum += dd[rlist->seg[i]];
-                        for (i = 10; rlist->seg[i] > 0; i--)
-                                sum -= dd[rlist->seg[i]];
-                        if (sum < minl) {
-                                minl = sum;
-                                bestrlist = rlist;
-                        }
-                        l[j++] = sum;
-                }
+// For medium-degree, i.e., FLUTE_D+1 <= d
+////////////////////////////////////////////////////////////////
 
-                t.branch[0].x = xs[s[0]];
-                t.branch[0].y = ys[0];
-                t.branch[1].x = xs[s[1]];
-                t.branch[1].y = ys[1];
-                for (i = 2; i < d - 2; i++) {
-                        t.branch[i].x = xs[s[i]];
-                        t.branch[i].y = ys[i];
-                        t.branch[i].n = bestrlist->neighbor[i];
-                }
-                t.branch[d - 2].x = xs[s[d - 2]];
-                t.branch[d - 2].y = ys[d - 2];
-                t.branch[d - 1].x = xs[s[d - 1]];
-                t.branch[d - 1].y = ys[d - 1];
-                if (hflip) {
-                        if (s[1] < s[0]) {
-                                t.branch[0].n = bestrlist->neighbor[1];
-                                t.branch[1].n = bestrlist->neighbor[0];
-                        } else {
-                                t.branch[0].n = bestrlist->neighbor[0];
-                                t.branch[1].n = bestrlist->neighbor[1];
-                        }
-                        if (s[d - 1] < s[d - 2]) {
-                                t.branch[d - 2].n = bestrlist->neighbor[d - 1];
-                                t.branch[d - 1].n = bestrlist->neighbor[d - 2];
-                        } else {
-                                t.branch[d - 2].n = bestrlist->neighbor[d - 2];
-                                t.branch[d - 1].n = bestrlist->neighbor[d - 1];
-                        }
-                        for (i = d; i < 2 * d - 2; i++) {
-                                t.branch[i].x = xs[d - 1 - bestrlist->rowcol[i - d] % 16];
-                                t.branch[i].y = ys[bestrlist->rowcol[i - d] / 16];
-                                t.branch[i].n = bestrlist->neighbor[i];
-                        }
-                } else {  // !hflip
-                        if (s[0] < s[1]) {
-                                t.branch[0].n = bestrlist->neighbor[1];
-                                t.branch[1].n = bestrlist->neighbor[0];
-                        } else {
-                                t.branch[0].n = bestrlist->neighbor[0];
-                                t.branch[1].n = bestrlist->neighbor[1];
-                        }
-                        if (s[d - 2] < s[d - 1]) {
-                                t.branch[d - 2].n = bestrlist->neighbor[d - 1];
-                                t.branch[d - 1].n = bestrlist->neighbor[d - 2];
-                        } else {
-                                t.branch[d - 2].n = bestrlist->neighbor[d - 2];
-                                t.branch[d - 1].n = bestrlist->neighbor[d - 1];
-                        }
-                        for (i = d; i < 2 * d - 2; i++) {
-                                t.branch[i].x = xs[bestrlist->rowcol[i - d] % 16];
-                                t.branch[i].y = ys[bestrlist->rowcol[i - d] / 16];
-                                t.branch[i].n = bestrlist->neighbor[i];
-                        }
-                }
-        }
-        t.length = minl;
+// Parallel breaking.
+// flute_parallel() sets the parallel context of the calling thread, and the
+// tasks it spawns set it on the threads they run on.
+struct parallel_ctx {
+        const Executor *executor;
+        int min_d;  // min. degree of the nets whose subtrees are tasks
+};
+
+static thread_local const struct parallel_ctx *parallel_context = NULL;
+
+// A subtree of a net broken by flutes_MD().
+struct md_subtree {
+        int d;
+        DTYPE *xs, *ys;
+        int *s;
+        Tree t;
+};
+
+// Returns true if the subtrees of the breakings of a net of degree d are
+// to be solved as tasks.
+static bool
+parallelBreaking(int d) {
+  return parallel_context != NULL && d >= parallel_context->min_d
+    && flute_arena.depth > 0;
+}
+
+// Returns a lower bound on the length of a breaking into sub1 and sub2, which
+// share pin i1 of sub1 and pin i2 of sub2, as flutes_MD() measures it, with
+// sub1 counted at its half-perimeter unless solved1 is set. The merge saves
+// along y if in_x is set, i.e., if the breaking is in x, or along x.
+static DTYPE
+breakingBound(const struct md_subtree *sub1, int i1,
+              const struct md_subtree *sub2, int i2, bool in_x,
+              bool solved1) {
+  const int d1 = sub1->d, d2 = sub2->d;
+  DTYPE pin, lo1, hi1, lo2, hi2, saving;
+  if (in_x) {
+    pin = sub2->ys[i2];
+    lo1 = sub1->ys[0], hi1 = sub1->ys[d1 - 1];
+    lo2 = sub2->ys[0], hi2 = sub2->ys[d2 - 1];
+  } else {
+    pin = sub2->xs[sub2->s[i2]];
+    lo1 = sub1->xs[0], hi1 = sub1->xs[d1 - 1];
+    lo2 = sub2->xs[0], hi2 = sub2->xs[d2 - 1];
+  }
+  if (solved1) {
+    const Branch b = sub1->t.branch[sub1->t.branch[i1].n];
+    saving = mergeSavingBound(pin, in_x ? b.y : b.x, lo2, hi2);
+  } else {
+    // The neighbor lies within the bounding box of sub1.
+    saving = std::max(mergeSavingBound(pin, lo1, lo2, hi2),
+                      mergeSavingBound(pin, hi1, lo2, hi2));
+  }
+  return (solved1 ? sub1->t.length : halfPerimeter(d1, sub1->xs, sub1->ys))
+      + halfPerimeter(d2, sub2->xs, sub2->ys) - saving;
+}
+
+// Sets sub[i].t = flutes_LMD(sub[i].d, sub[i].xs, sub[i].ys, sub[i].s, acc)
+// for the n subtrees of the breakings of a net of degree d, with the
+// branches allocated in order of i.
+static void
+solveSubtrees(int d, struct md_subtree sub[], int n, int acc) {
+  breaking_stats.solved += n;
+  if (!parallelBreaking(d)) {
+    for (int i = 0; i < n; i++)
+      sub[i].t = flutes_LMD(sub[i].d, sub[i].xs, sub[i].ys, sub[i].s, acc);
+    return;
+  }
 
+  // The tasks may run on other threads, in their arenas, so their trees are
+  // copied to branches allocated here, and their statistics are added to
+  // those of this thread.
+  BreakingStats *stats = (BreakingStats *)fluteAlloc(n * sizeof(BreakingStats));
+  for (int i = 0; i < n; i++)
+    sub[i].t.branch = (Branch *)fluteAlloc((2 * sub[i].d - 2) * sizeof(Branch));
+  const struct parallel_ctx *ctx = parallel_context;
+  (*ctx->executor)(n, [ctx, sub, acc, stats](int i) {
+    const struct parallel_ctx *saved = parallel_context;
+    const BreakingStats saved_stats = breaking_stats;
+    parallel_context = ctx;
+    resetBreakingStats();
+    {
+      struct arena_scope scope;
+      Tree t = flutes_LMD(sub[i].d, sub[i].xs, sub[i].ys, sub[i].s, acc);
+      memcpy(sub[i].t.branch, t.branch, (2 * t.deg - 2) * sizeof(Branch));
+      sub[i].t.deg = t.deg;
+      sub[i].t.length = t.length;
+    }
+    stats[i] = breaking_stats;
+    breaking_stats = saved_stats;
+    parallel_context = saved;
+  });
+  for (int i = 0; i < n; i++) {
+    breaking_stats.solved += stats[i].solved;
+    breaking_stats.pruned += stats[i].pruned;
+  }
+  fluteFree(stats);
+}
+
+Tree flute_parallel(int d, DTYPE x[], DTYPE y[], int acc,
+                    const Executor &executor,
+                    int min_parallel_d) {
+  struct parallel_ctx ctx = {&executor, std::max(min_parallel_d, FLUTE_D + 1)};
+  const struct parallel_ctx *saved = parallel_context;
+  parallel_context = &ctx;
+  Tree t = flute(d, x, y, acc);
+  parallel_context = saved;
+  return t;
+}
+
+// Answers the subproblem from the memo if it is there, or solves it with
+// solveMD() and adds it.
+Tree flutes_MD(int d, DTYPE xs[], DTYPE ys[], int s[], int acc) {
+        uint64_t key = memoKey(d, xs, ys, s, acc, true);
+        const struct memo_entry *entry = findMemo(key, d, xs, ys, s, acc, true);
+        Tree t;
+        if (entry != NULL) {
+                t.deg = d;
+                t.length = entry->length;
+                t.branch = (Branch *)fluteAlloc((2 * d - 2) * sizeof(Branch));
+                memcpy(t.branch, &flute_memo.branches[entry->branch],
+                       (2 * d - 2) * sizeof(Branch));
+                return t;
+        }
+        t = solveMD(d, xs, ys, s, acc);
+        addMemo(key, d, xs, ys, s, acc, &t, 0);
         return t;
 }
 
-// For medium-degree, i.e., FLUTE_D+1 <= d
-Tree flutes_MD(int d, DTYPE xs[], DTYPE ys[], int s[], int acc) 
-{
+static Tree
+solveMD(int d, DTYPE xs[], DTYPE ys[], int s[], int acc) {
         float *score, *penalty, pnlty, dx, dy;
         int ms, mins, maxs, minsi, maxsi;
         int i, r, p, maxbp, bestbp, bp, nbp, ub, lb, n1, n2, nn1, nn2, newacc;
@@ -1287,20 +1978,25 @@ Tree flutes_MD(int d, DTYPE xs[], DTYPE ys[], int s[], int acc)
         DTYPE ll, minl, coord1, coord2;
         DTYPE *distx, *disty, xydiff;
         DTYPE *x1, *x2, *y1, *y2;
-        
+        DTYPE *cx1, *cx2, *cy1, *cy2;
+        int *cs1, *cs2, *cand, c, ncand;
+        struct md_subtree *sub;
+        struct arena_mark mark, best_mark, cand_mark;
+
+        mark = arenaMark();
         degree = d + 1;
-        score = (float *)malloc(sizeof(float) * (2 * degree));
-        penalty = (float *)malloc(sizeof(float) * (degree));
+        score = (float *)fluteAlloc(sizeof(float) * (2 * degree));
+        penalty = (float *)fluteAlloc(sizeof(float) * (degree));
         
-        x1 = (DTYPE *)malloc(sizeof(DTYPE) * (degree));
-        x2 = (DTYPE *)malloc(sizeof(DTYPE) * (degree));
-        y1 = (DTYPE *)malloc(sizeof(DTYPE) * (degree));
-        y2 = (DTYPE *)malloc(sizeof(DTYPE) * (degree));
-        distx = (DTYPE *)malloc(sizeof(DTYPE) * (degree));
-        disty = (DTYPE *)malloc(sizeof(DTYPE) * (degree));
-        si = (int *)malloc(sizeof(int) * (degree));
-        s1 = (int *)malloc(sizeof(int) * (degree));
-        s2 = (int *)malloc(sizeof(int) * (degree));
+        x1 = (DTYPE *)fluteAlloc(sizeof(DTYPE) * (degree));
+        x2 = (DTYPE *)fluteAlloc(sizeof(DTYPE) * (degree));
+        y1 = (DTYPE *)fluteAlloc(sizeof(DTYPE) * (degree));
+        y2 = (DTYPE *)fluteAlloc(sizeof(DTYPE) * (degree));
+        distx = (DTYPE *)fluteAlloc(sizeof(DTYPE) * (degree));
+        disty = (DTYPE *)fluteAlloc(sizeof(DTYPE) * (degree));
+        si = (int *)fluteAlloc(sizeof(int) * (degree));
+        s1 = (int *)fluteAlloc(sizeof(int) * (degree));
+        s2 = (int *)fluteAlloc(sizeof(int) * (degree));
 
         if (s[0] < s[d - 1]) {
                 ms = std::max(s[0], s[1]);
@@ -1320,23 +2016,28 @@ Tree flutes_MD(int d, DTYPE xs[], DTYPE ys[], int s[], int acc)
                         for (i = 1; i <= d - 1 - ms; i++)
                                 s2[i] = s[i + ms] - ms;
 
-                        t1 = flutes_LMD(ms + 2, x1, y1, s1, acc);
-                        t2 = flutes_LMD(d - ms, xs + ms, ys + ms, s2, acc);
+                        struct md_subtree halves[2] = {
+                                {ms + 2, x1, y1, s1, Tree()},
+                                {d - ms, xs + ms, ys + ms, s2, Tree()}};
+                        solveSubtrees(d, halves, 2, acc);
+                        t1 = halves[0].t;
+                        t2 = halves[1].t;
                         t = dmergetree(t1, t2);
-                        free(t1.branch);
-                        free(t2.branch);
+                        fluteFree(t1.branch);
+                        fluteFree(t2.branch);
                         
-                        free(score);
-                        free(penalty);
-                        free(x1);
-                        free(x2);
-                        free(y1);
-                        free(y2);
-                        free(distx);
-                        free(disty);
-                        free(si);
-                        free(s1);
-                        free(s2);
+                        fluteFree(score);
+                        fluteFree(penalty);
+                        fluteFree(x1);
+                        fluteFree(x2);
+                        fluteFree(y1);
+                        fluteFree(y2);
+                        fluteFree(distx);
+                        fluteFree(disty);
+                        fluteFree(si);
+                        fluteFree(s1);
+                        fluteFree(s2);
+                        arenaKeep(mark, &t, NULL);
                         
                         return t;
                 }
@@ -1361,23 +2062,28 @@ Tree flutes_MD(int d, DTYPE xs[], DTYPE ys[], int s[], int acc)
                         for (i = 1; i <= ms; i++)
                                 s2[i] = s[i + d - 1 - ms];
 
-                        t1 = flutes_LMD(d + 1 - ms, x1, y1, s1, acc);
-                        t2 = flutes_LMD(ms + 1, xs, ys + d - 1 - ms, s2, acc);
+                        struct md_subtree halves[2] = {
+                                {d + 1 - ms, x1, y1, s1, Tree()},
+                                {ms + 1, xs, ys + d - 1 - ms, s2, Tree()}};
+                        solveSubtrees(d, halves, 2, acc);
+                        t1 = halves[0].t;
+                        t2 = halves[1].t;
                         t = dmergetree(t1, t2);
-                        free(t1.branch);
-                        free(t2.branch);
+                        fluteFree(t1.branch);
+                        fluteFree(t2.branch);
                         
-                        free(score);
-                        free(penalty);
-                        free(x1);
-                        free(x2);
-                        free(y1);
-                        free(y2);
-                        free(distx);
-                        free(disty);
-                        free(si);
-                        free(s1);
-                        free(s2);
+                        fluteFree(score);
+                        fluteFree(penalty);
+                        fluteFree(x1);
+                        fluteFree(x2);
+                        fluteFree(y1);
+                        fluteFree(y2);
+                        fluteFree(distx);
+                        fluteFree(disty);
+                        fluteFree(si);
+                        fluteFree(s1);
+                        fluteFree(s2);
+                        arenaKeep(mark, &t, NULL);
 
                         return t;
                 }
@@ -1480,89 +2186,167 @@ Tree flutes_MD(int d, DTYPE xs[], DTYPE ys[], int s[], int acc)
                 if (acc >= nbp) acc = nbp - 1;
         }
 
+        // The subtrees of every candidate breaking are built as trees, not
+        // scored with flutes_wl_MD() first: the length of a breaking takes off
+        // what merging saves, which depends on the neighbors of the shared
+        // pin in both subtrees, and flutes_wl_MD() measures breakings without
+        // it, so it may prefer another one and change the tree. The subtrees
+        // of the best breaking so far are kept, so the winner is merged
+        // without being built again.
+        //
+        // Breakings are solved ncand at a time: one by one, or all of them
+        // together if their subtrees are tasks. Then each one needs inputs of
+        // its own, taken from the arena, so the scratch arrays above are
+        // simply dropped.
+        ncand = parallelBreaking(d) ? acc : 1;
+        if (ncand > 1) {
+                x1 = (DTYPE *)fluteAlloc(sizeof(DTYPE) * degree * ncand);
+                x2 = (DTYPE *)fluteAlloc(sizeof(DTYPE) * degree * ncand);
+                y1 = (DTYPE *)fluteAlloc(sizeof(DTYPE) * degree * ncand);
+                y2 = (DTYPE *)fluteAlloc(sizeof(DTYPE) * degree * ncand);
+                s1 = (int *)fluteAlloc(sizeof(int) * degree * ncand);
+                s2 = (int *)fluteAlloc(sizeof(int) * degree * ncand);
+        }
+        cand = (int *)fluteAlloc(sizeof(int) * 3 * ncand);  // bp, nn1, nn2
+        sub = (struct md_subtree *)fluteAlloc(sizeof(struct md_subtree) * 2 * ncand);
+
         minl = (DTYPE)INT_MAX;
         bestt1.branch = bestt2.branch = NULL;
-        for (i = 0; i < acc; i++) {
-                maxbp = 0;
-                for (bp = 1; bp < nbp; bp++)
-                        if (score[maxbp] < score[bp]) maxbp = bp;
-                score[maxbp] = -9e9;
+        // The best trees so far start at best_mark, the candidates at cand_mark.
+        best_mark = cand_mark = arenaMark();
+        for (i = 0; i < acc; i += ncand) {
+                for (c = 0; c < ncand; c++) {
+                        maxbp = 0;
+                        for (bp = 1; bp < nbp; bp++)
+                                if (score[maxbp] < score[bp]) maxbp = bp;
+                        score[maxbp] = -9e9;
 
 #define BreakPt(bp) ((bp) / 2 + lb)
 #define BreakInX(bp) ((bp) % 2 == 0)
-                p = BreakPt(maxbp);
-                // Breaking in p
-                if (BreakInX(maxbp)) {  // break in x
-                        n1 = n2 = 0;
-                        for (r = 0; r < d; r++) {
-                                if (s[r] < p) {
-                                        s1[n1] = s[r];
-                                        y1[n1] = ys[r];
-                                        n1++;
-                                } else if (s[r] > p) {
-                                        s2[n2] = s[r] - p;
-                                        y2[n2] = ys[r];
-                                        n2++;
-                                } else {  // if (s[r] == p)  i.e.,  r = si[p]
-                                        s1[n1] = p;
-                                        s2[n2] = 0;
-                                        y1[n1] = y2[n2] = ys[r];
-                                        nn1 = n1;
-                                        nn2 = n2;
-                                        n1++;
-                                        n2++;
+                        p = BreakPt(maxbp);
+                        cx1 = x1 + c * degree, cx2 = x2 + c * degree;
+                        cy1 = y1 + c * degree, cy2 = y2 + c * degree;
+                        cs1 = s1 + c * degree, cs2 = s2 + c * degree;
+                        // Breaking in p
+                        if (BreakInX(maxbp)) {  // break in x
+                                n1 = n2 = 0;
+                                for (r = 0; r < d; r++) {
+                                        if (s[r] < p) {
+                                                cs1[n1] = s[r];
+                                                cy1[n1] = ys[r];
+                                                n1++;
+                                        } else if (s[r] > p) {
+                                                cs2[n2] = s[r] - p;
+                                                cy2[n2] = ys[r];
+                                                n2++;
+                                        } else {  // if (s[r] == p)  i.e.,  r = si[p]
+                                                cs1[n1] = p;
+                                                cs2[n2] = 0;
+                                                cy1[n1] = cy2[n2] = ys[r];
+                                                nn1 = n1;
+                                                nn2 = n2;
+                                                n1++;
+                                                n2++;
+                                        }
+                                }
+                                sub[2 * c] = {p + 1, xs, cy1, cs1, Tree()};
+                                sub[2 * c + 1] = {d - p, xs + p, cy2, cs2, Tree()};
+                                cand[3 * c + 1] = nn1;
+                                cand[3 * c + 2] = nn2;
+                        } else {  // if (!BreakInX(maxbp))
+                                n1 = n2 = 0;
+                                for (r = 0; r < d; r++) {
+                                        if (si[r] < p) {
+                                                cs1[si[r]] = n1;
+                                                cx1[n1] = xs[r];
+                                                n1++;
+                                        } else if (si[r] > p) {
+                                                cs2[si[r] - p] = n2;
+                                                cx2[n2] = xs[r];
+                                                n2++;
+                                        } else {  // if (si[r] == p)  i.e.,  r = s[p]
+                                                cs1[p] = n1;
+                                                cs2[0] = n2;
+                                                cx1[n1] = cx2[n2] = xs[r];
+                                                n1++;
+                                                n2++;
+                                        }
                                 }
+                                sub[2 * c] = {p + 1, cx1, ys, cs1, Tree()};
+                                sub[2 * c + 1] = {d - p, cx2, ys + p, cs2, Tree()};
                         }
+                        cand[3 * c] = maxbp;
+                }
 
-                        t1 = flutes_LMD(p + 1, xs, y1, s1, newacc);
-                        t2 = flutes_LMD(d - p, xs + p, y2, s2, newacc);
-                        ll = t1.length + t2.length;
-                        coord1 = t1.branch[t1.branch[nn1].n].y;
-                        coord2 = t2.branch[t2.branch[nn2].n].y;
-                        if (t2.branch[nn2].y > std::max(coord1, coord2))
-                                ll -= t2.branch[nn2].y - std::max(coord1, coord2);
-                        else if (t2.branch[nn2].y < std::min(coord1, coord2))
-                                ll -= std::min(coord1, coord2) - t2.branch[nn2].y;
-                } else {  // if (!BreakInX(maxbp))
-                        n1 = n2 = 0;
-                        for (r = 0; r < d; r++) {
-                                if (si[r] < p) {
-                                        s1[si[r]] = n1;
-                                        x1[n1] = xs[r];
-                                        n1++;
-                                } else if (si[r] > p) {
-                                        s2[si[r] - p] = n2;
-                                        x2[n2] = xs[r];
-                                        n2++;
-                                } else {  // if (si[r] == p)  i.e.,  r = s[p]
-                                        s1[p] = n1;
-                                        s2[0] = n2;
-                                        x1[n1] = x2[n2] = xs[r];
-                                        n1++;
-                                        n2++;
-                                }
+                if (ncand == 1) {
+                        // Branch and bound, solving one subtree at a time.
+                        if (BreakInX(cand[0])) {
+                                nn1 = cand[1];
+                                nn2 = cand[2];
+                        } else {
+                                nn1 = BreakPt(cand[0]);
+                                nn2 = 0;
+                        }
+                        if (breakingBound(&sub[0], nn1, &sub[1], nn2,
+                                          BreakInX(cand[0]), false) >= minl) {
+                                breaking_stats.pruned += 2;
+                                continue;
                         }
+                        solveSubtrees(d, sub, 1, newacc);
+                        if (breakingBound(&sub[0], nn1, &sub[1], nn2,
+                                          BreakInX(cand[0]), true) >= minl) {
+                                breaking_stats.pruned++;
+                                fluteFree(sub[0].t.branch);
+                                arenaRelease(cand_mark);
+                                continue;
+                        }
+                        solveSubtrees(d, sub + 1, 1, newacc);
+                } else {
+                        solveSubtrees(d, sub, 2 * ncand, newacc);
+                }
 
-                        t1 = flutes_LMD(p + 1, x1, ys, s1, newacc);
-                        t2 = flutes_LMD(d - p, x2, ys + p, s2, newacc);
+                for (c = 0; c < ncand; c++) {
+                        maxbp = cand[3 * c];
+                        p = BreakPt(maxbp);
+                        t1 = sub[2 * c].t;
+                        t2 = sub[2 * c + 1].t;
                         ll = t1.length + t2.length;
-                        coord1 = t1.branch[t1.branch[p].n].x;
-                        coord2 = t2.branch[t2.branch[0].n].x;
-                        if (t2.branch[0].x > std::max(coord1, coord2))
-                                ll -= t2.branch[0].x - std::max(coord1, coord2);
-                        else if (t2.branch[0].x < std::min(coord1, coord2))
-                                ll -= std::min(coord1, coord2) - t2.branch[0].x;
-                }
-                if (minl > ll) {
-                        minl = ll;
-                        free(bestt1.branch);
-                        free(bestt2.branch);
-                        bestt1 = t1;
-                        bestt2 = t2;
-                        bestbp = maxbp;
-                } else {
-                        free(t1.branch);
-                        free(t2.branch);
+                        if (BreakInX(maxbp)) {
+                                nn1 = cand[3 * c + 1];
+                                nn2 = cand[3 * c + 2];
+                                coord1 = t1.branch[t1.branch[nn1].n].y;
+                                coord2 = t2.branch[t2.branch[nn2].n].y;
+                                if (t2.branch[nn2].y > std::max(coord1, coord2))
+                                        ll -= t2.branch[nn2].y - std::max(coord1, coord2);
+                                else if (t2.branch[nn2].y < std::min(coord1, coord2))
+                                        ll -= std::min(coord1, coord2) - t2.branch[nn2].y;
+                        } else {
+                                coord1 = t1.branch[t1.branch[p].n].x;
+                                coord2 = t2.branch[t2.branch[0].n].x;
+                                if (t2.branch[0].x > std::max(coord1, coord2))
+                                        ll -= t2.branch[0].x - std::max(coord1, coord2);
+                                else if (t2.branch[0].x < std::min(coord1, coord2))
+                                        ll -= std::min(coord1, coord2) - t2.branch[0].x;
+                        }
+                        if (minl > ll) {
+                                minl = ll;
+                                fluteFree(bestt1.branch);
+                                fluteFree(bestt2.branch);
+                                bestt1 = t1;
+                                bestt2 = t2;
+                                bestbp = maxbp;
+                                // Move them over the previous best, unless
+                                // other candidates are still above them.
+                                if (ncand == 1) {
+                                        arenaKeep(best_mark, &bestt1, &bestt2);
+                                        cand_mark = arenaMark();
+                                }
+                        } else {
+                                fluteFree(t1.branch);
+                                fluteFree(t2.branch);
+                                if (ncand == 1)
+                                        arenaRelease(cand_mark);
+                        }
                 }
         }
 
@@ -1582,21 +2366,24 @@ Tree flutes_MD(int d, DTYPE xs[], DTYPE ys[], int s[], int acc)
         }
 #endif
 
-        free(bestt1.branch);
-        free(bestt2.branch);
-
-        free(score);
-        free(penalty);
-        free(x1);
-        free(x2);
-        free(y1);
-        free(y2);
-        free(distx);
-        free(disty);
-        free(si);
-        free(s1);
-        free(s2);
-        
+        fluteFree(bestt1.branch);
+        fluteFree(bestt2.branch);
+
+        fluteFree(score);
+        fluteFree(penalty);
+        fluteFree(x1);
+        fluteFree(x2);
+        fluteFree(y1);
+        fluteFree(y2);
+        fluteFree(distx);
+        fluteFree(disty);
+        fluteFree(si);
+        fluteFree(s1);
+        fluteFree(s2);
+        fluteFree(cand);
+        fluteFree(sub);
+        arenaKeep(mark, &t, NULL);
+
         return t;
 }
 
@@ -1606,7 +2393,7 @@ Tree dmergetree(Tree t1, Tree t2) {
 
         t.deg = d = t1.deg + t2.deg - 2;
         t.length = t1.length + t2.length;
-        t.branch = (Branch *)malloc((2 * d - 2) * sizeof(Branch));
+        t.branch = (Branch *)fluteAlloc((2 * d - 2) * sizeof(Branch));
         offset1 = t2.deg - 2;
         offset2 = 2 * t1.deg - 4;
 
@@ -1653,7 +2440,7 @@ Tree hmergetree(Tree t1, Tree t2, int s[]) {
 
         t.deg = t1.deg + t2.deg - 1;
         t.length = t1.length + t2.length;
-        t.branch = (Branch *)malloc((2 * t.deg - 2) * sizeof(Branch));
+        t.branch = (Branch *)fluteAlloc((2 * t.deg - 2) * sizeof(Branch));
         offset1 = t2.deg - 1;
         offset2 = 2 * t1.deg - 3;
 
@@ -1727,7 +2514,7 @@ Tree vmergetree(Tree t1, Tree t2) {
 
         t.deg = t1.deg + t2.deg - 1;
         t.length = t1.length + t2.length;
-        t.branch = (Branch *)malloc((2 * t.deg - 2) * sizeof(Branch));
+        t.branch = (Branch *)fluteAlloc((2 * t.deg - 2) * sizeof(Branch));
         offset1 = t2.deg - 1;
         offset2 = 2 * t1.deg - 3;
 
@@ -1785,14 +2572,15 @@ void local_refinement(int deg, Tree *tp, int p) {
         int *SteinerPin, *index, *ss, degree;
         DTYPE *x, *xs, *ys;
         Tree tt;
+        struct arena_mark mark = arenaMark();
         
         degree = deg + 1;
-        SteinerPin = (int *)malloc(sizeof(int) * (2 * degree));
-        index = (int *)malloc(sizeof(int) * (2 * degree));
-        x = (DTYPE *)malloc(sizeof(DTYPE) * (degree));
-        xs = (DTYPE *)malloc(sizeof(DTYPE) * (degree));
-        ys = (DTYPE *)malloc(sizeof(DTYPE) * (degree));
-        ss = (DTYPE *)malloc(sizeof(DTYPE) * (degree));
+        SteinerPin = (int *)fluteAlloc(sizeof(int) * (2 * degree));
+        index = (int *)fluteAlloc(sizeof(int) * (2 * degree));
+        x = (DTYPE *)fluteAlloc(sizeof(DTYPE) * (degree));
+        xs = (DTYPE *)fluteAlloc(sizeof(DTYPE) * (degree));
+        ys = (DTYPE *)fluteAlloc(sizeof(DTYPE) * (degree));
+        ss = (DTYPE *)fluteAlloc(sizeof(DTYPE) * (degree));
 
         d = tp->deg;
         root = tp->branch[p].n;
@@ -1882,15 +2670,16 @@ void local_refinement(int deg, Tree *tp, int p) {
                         tp->branch[index[ii]].y = tt.branch[ii].y;
                         tp->branch[index[ii]].n = index[tt.branch[ii].n];
                 }
-                free(tt.branch);
+                fluteFree(tt.branch);
         }
 
-        free(SteinerPin);
-        free(index);
-        free(x);
-        free(xs);
-        free(ys);
-        free(ss);
+        fluteFree(SteinerPin);
+        fluteFree(index);
+        fluteFree(x);
+        fluteFree(xs);
+        fluteFree(ys);
+        fluteFree(ss);
+        arenaRelease(mark);
         
         return;
 }
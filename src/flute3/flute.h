@@ -32,6 +32,9 @@
 #ifndef __FLUTE_H__
 #define __FLUTE_H__
 
+#include <stddef.h>
+#include <functional>
+
 namespace Flute {
 
 /*****************************/
@@ -44,7 +47,10 @@ namespace Flute {
 
 #define FLUTE_POWVFILE "POWV9.dat"  // LUT for POWV (Wirelength Vector)
 #define FLUTE_POSTFILE "POST9.dat"  // LUT for POST (Steiner Tree)
+#define FLUTE_LUTIMAGE "FLUTE9.lut" // Precompiled image of both LUTs
 #define FLUTE_D 9                   // LUT is used for d <= FLUTE_D, FLUTE_D <= 9
+#define FLUTE_PARALLEL_D 256        // Default min. degree for flute_parallel() tasks
+#define FLUTE_MEMO_BYTES (32 << 20) // Max. memo of subproblems per thread
 
 typedef int DTYPE;
 
@@ -60,10 +66,46 @@ typedef struct {
 } Tree;
 
 // User-Callable Functions
+// readLUT() and ensureLUT() load each table once and may be called from any
+// thread; the loaded tables are shared read-only by concurrent flute calls.
 void readLUT();
+void ensureLUT(int d);  // Make sure the LUT for degree d is loaded
+
+// Precompiled LUT image: writeLUTImage() saves the decoded LUTs of every
+// degree; readLUTImage() maps such a file and useLUTImage() takes an image
+// already in memory (e.g. compiled in), both using it in place without
+// decoding. They return false, leaving the LUTs alone, if the image is
+// missing or invalid or the LUTs are already loaded.
+bool readLUTImage(const char *filename);
+bool useLUTImage(const void *image, size_t size);
+bool writeLUTImage(const char *filename);
 void deleteLUT();
 DTYPE flute_wl(int d, DTYPE x[], DTYPE y[], int acc);
 Tree flute(int d, DTYPE x[], DTYPE y[], int acc);
+
+// Parallel breaking: an Executor runs task(0) .. task(n-1), possibly
+// concurrently, and returns once all of them have finished. Tasks may call
+// the executor again. flute_parallel() returns the same tree as flute(), but
+// flutes_MD() solves the subtrees of its breakings of nets with degree >=
+// min_parallel_d as tasks on executor.
+typedef std::function<void(int n, const std::function<void(int)> &task)> Executor;
+Tree flute_parallel(int d, DTYPE x[], DTYPE y[], int acc,
+                    const Executor &executor,
+                    int min_parallel_d = FLUTE_PARALLEL_D);
+
+// Branch and bound: flutes_MD() and flutes_wl_MD() skip the subtrees of a
+// breaking once a lower bound on its length shows that it cannot beat the
+// best breaking so far, which leaves the results unchanged. The calls on a
+// thread count the subtrees of breakings they solve and skip; reset the
+// counts before a net and read them after it for the statistics of the net.
+// flute_parallel() counts the subtrees solved as tasks on the calling thread.
+typedef struct {
+        long long solved;  // subtrees solved
+        long long pruned;  // subtrees skipped
+} BreakingStats;
+BreakingStats breakingStats();
+void resetBreakingStats();
+
 DTYPE wirelength(Tree t);
 void printtree(Tree t);
 void plottree(Tree t);
@@ -5,7 +5,10 @@
 #define GRAPH_H_
 
 #include <tuple>       // for std::tie
+#include <cstddef>
+#include <cstdint>
 #include <functional>  // for std::hash
+#include <vector>
 
 namespace graph {
 
@@ -58,11 +61,38 @@ struct Edge {
   Node<T> end;    // End node.
 };
 
+// Net struct.
+// A net is a set of nodes to be connected within a boundary.
+template <typename T>
+struct Net {
+  Boundary<T> boundary;        // Boundary of the net.
+  std::vector<Node<T>> nodes;  // Nodes of the net.
+};
+
 // Define aliases for convenience.
 // Only 'int' is used in this assignment.
 using Boundary_i = Boundary<int>;
 using Node_i = Node<int>;
 using Edge_i = Edge<int>;
+using Net_i = Net<int>;
+
+// Packs a node into a 64-bit key: x in the upper half, y in the lower one.
+inline std::uint64_t PackNode(const Node_i& node) {
+  return static_cast<std::uint64_t>(static_cast<std::uint32_t>(node.x)) << 32 |
+         static_cast<std::uint32_t>(node.y);
+}
+
+// Mixes the bits of a 64-bit key so that every input bit affects every output
+// bit (the MurmurHash3 finalizer). Keys that differ in a few low bits, as the
+// coordinates of neighboring grid points do, spread over the whole range.
+inline std::uint64_t MixKey(std::uint64_t key) {
+  key ^= key >> 33;
+  key *= 0xff51afd7ed558ccdULL;
+  key ^= key >> 33;
+  key *= 0xc4ceb9fe1a85ec53ULL;
+  key ^= key >> 33;
+  return key;
+}
 
 }  // namespace graph
 
@@ -71,8 +101,7 @@ namespace std {
 template <>
 struct hash<graph::Node<int>> {
   std::size_t operator()(const graph::Node<int>& p) const {
-    // Combine hashes for x and y
-    return std::hash<int>()(p.x) ^ (std::hash<int>()(p.y) << 1);
+    return static_cast<std::size_t>(graph::MixKey(graph::PackNode(p)));
   }
 };
 }
@@ -0,0 +1,618 @@
+/*******************************************************************************
+ * Feel free to use, modify, and/or distribute this code as you see fit.
+ ******************************************************************************/
+#include "incremental_net.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <numeric>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include "flute.h"
+#include "graph.h"
+#include "steiner_tree_builder.h"
+
+namespace steiner {
+
+namespace {
+
+// Accuracy of FLUTE, as in SteinerTreeBuilder::Solve().
+constexpr int kAccuracy = 9;
+
+// Number of vertices around a change that a local repair solves again.
+constexpr std::size_t kRepairSize = 24;
+
+long long Distance(const graph::Node_i& a, const graph::Node_i& b) {
+  return std::llabs(static_cast<long long>(a.x) - b.x) +
+         std::llabs(static_cast<long long>(a.y) - b.y);
+}
+
+// Splits the axis-aligned `segments` at every point where another one crosses
+// them or ends on them, so that the pieces only meet at their ends. Pieces of
+// overlapping segments are returned once.
+std::vector<graph::Edge_i> SplitSegments(
+    const std::vector<graph::Edge_i>& segments) {
+  // The points to split each row and each column at.
+  std::unordered_map<int, std::vector<int>> row_cuts;
+  std::unordered_map<int, std::vector<int>> col_cuts;
+  std::vector<graph::Edge_i> vertical;
+  for (const graph::Edge_i& e : segments) {
+    for (const graph::Node_i& p : {e.start, e.end}) {
+      row_cuts[p.y].push_back(p.x);
+      col_cuts[p.x].push_back(p.y);
+    }
+    if (e.start.x == e.end.x && e.start.y != e.end.y) {
+      vertical.push_back(e);
+    }
+  }
+  std::sort(vertical.begin(), vertical.end(),
+            [](const graph::Edge_i& a, const graph::Edge_i& b) {
+              return a.start.x < b.start.x;
+            });
+  for (const graph::Edge_i& e : segments) {
+    if (e.start.y != e.end.y || e.start.x == e.end.x) {
+      continue;
+    }
+    const int xl = std::min(e.start.x, e.end.x);
+    const int xh = std::max(e.start.x, e.end.x);
+    const int y = e.start.y;
+    auto it = std::lower_bound(vertical.begin(), vertical.end(), xl,
+                               [](const graph::Edge_i& v, int x) {
+                                 return v.start.x < x;
+                               });
+    for (; it != vertical.end() && it->start.x <= xh; ++it) {
+      if (std::min(it->start.y, it->end.y) <= y &&
+          y <= std::max(it->start.y, it->end.y)) {
+        row_cuts[y].push_back(it->start.x);
+        col_cuts[it->start.x].push_back(y);
+      }
+    }
+  }
+  for (auto* cuts : {&row_cuts, &col_cuts}) {
+    for (auto& [line, points] : *cuts) {
+      std::sort(points.begin(), points.end());
+      points.erase(std::unique(points.begin(), points.end()), points.end());
+    }
+  }
+
+  std::vector<std::pair<graph::Node_i, graph::Node_i>> pieces;
+  for (const graph::Edge_i& e : segments) {
+    const bool horizontal = e.start.y == e.end.y;
+    if (e.start == e.end || (!horizontal && e.start.x != e.end.x)) {
+      continue;
+    }
+    const int line = horizontal ? e.start.y : e.start.x;
+    const int lo = horizontal ? std::min(e.start.x, e.end.x)
+                              : std::min(e.start.y, e.end.y);
+    const int hi = horizontal ? std::max(e.start.x, e.end.x)
+                              : std::max(e.start.y, e.end.y);
+    const std::vector<int>& cuts = horizontal ? row_cuts[line] : col_cuts[line];
+    auto at = [horizontal, line](int c) {
+      return horizontal ? graph::Node_i(c, line) : graph::Node_i(line, c);
+    };
+    for (auto it = std::lower_bound(cuts.begin(), cuts.end(), lo);
+         *it != hi; ++it) {
+      pieces.emplace_back(at(*it), at(*(it + 1)));
+    }
+  }
+  std::sort(pieces.begin(), pieces.end());
+  pieces.erase(std::unique(pieces.begin(), pieces.end()), pieces.end());
+
+  std::vector<graph::Edge_i> edges;
+  edges.reserve(pieces.size());
+  for (const auto& [a, b] : pieces) {
+    edges.emplace_back(a, b);
+  }
+  return edges;
+}
+
+}  // namespace
+
+IncrementalNet::IncrementalNet(const graph::Boundary_i& /*boundary*/,
+                               const std::vector<graph::Node_i>& pins,
+                               double max_degradation)
+    : max_degradation_(max_degradation) {
+  Flute::readLUT();
+  for (const graph::Node_i& pin : pins) {
+    auto [it, inserted] = pin_vertex_.emplace(pin, 0);
+    if (inserted) {
+      it->second = NewVertex(pin);
+    }
+    ++vertices_[it->second].num_pins;
+  }
+  SolveFull();
+}
+
+void IncrementalNet::AddPin(const graph::Node_i& pin) {
+  Insert(pin);
+  CheckDegradation();
+}
+
+bool IncrementalNet::RemovePin(const graph::Node_i& pin) {
+  if (!Erase(pin)) {
+    return false;
+  }
+  CheckDegradation();
+  return true;
+}
+
+bool IncrementalNet::MovePin(const graph::Node_i& from,
+                             const graph::Node_i& to) {
+  if (from == to) {
+    return pin_vertex_.count(from) > 0;
+  }
+  if (!Erase(from)) {
+    return false;
+  }
+  Insert(to);
+  CheckDegradation();
+  return true;
+}
+
+std::vector<graph::Edge_i> IncrementalNet::Edges() const {
+  std::vector<graph::Node_i> points;
+  std::vector<std::pair<int, int>> links;
+  std::vector<int> index(vertices_.size(), -1);
+  for (std::size_t v = 0; v < vertices_.size(); ++v) {
+    if (vertices_[v].alive) {
+      index[v] = static_cast<int>(points.size());
+      points.push_back(vertices_[v].position);
+    }
+  }
+  for (std::size_t v = 0; v < vertices_.size(); ++v) {
+    for (int w : vertices_[v].adjacent) {
+      if (static_cast<int>(v) < w) {
+        links.emplace_back(index[v], index[w]);
+      }
+    }
+  }
+
+  // Repairs splice branches into diagonal links whose L shapes may cross other
+  // parts of the tree or end on them. Split the embedded segments wherever
+  // they meet, then keep the shortest pieces that do not close a cycle and
+  // leave out the dangling pieces this leaves.
+  std::vector<graph::Edge_i> pieces = SplitSegments(
+      SteinerTreeBuilder::EmbedTree(points, links));
+  std::stable_sort(pieces.begin(), pieces.end(),
+                   [](const graph::Edge_i& a, const graph::Edge_i& b) {
+                     return Distance(a.start, a.end) <
+                            Distance(b.start, b.end);
+                   });
+
+  std::unordered_map<graph::Node_i, int> node_index;
+  auto node = [&node_index](const graph::Node_i& p) {
+    return node_index.emplace(p, static_cast<int>(node_index.size()))
+        .first->second;
+  };
+  std::vector<int> parent;
+  auto find = [&parent](int i) {
+    while (parent[i] != i) {
+      i = parent[i] = parent[parent[i]];
+    }
+    return i;
+  };
+  std::vector<graph::Edge_i> kept;
+  std::vector<std::pair<int, int>> ends;
+  for (const graph::Edge_i& e : pieces) {
+    const int a = node(e.start);
+    const int b = node(e.end);
+    while (parent.size() < node_index.size()) {
+      parent.push_back(static_cast<int>(parent.size()));
+    }
+    if (find(a) != find(b)) {
+      parent[find(a)] = find(b);
+      kept.push_back(e);
+      ends.emplace_back(a, b);
+    }
+  }
+
+  // Prune the Steiner points that became leaves, one after another.
+  std::vector<std::vector<int>> incident(node_index.size());
+  for (std::size_t i = 0; i < ends.size(); ++i) {
+    incident[ends[i].first].push_back(static_cast<int>(i));
+    incident[ends[i].second].push_back(static_cast<int>(i));
+  }
+  std::vector<int> degree(node_index.size());
+  std::vector<graph::Node_i> position(node_index.size());
+  for (const auto& [p, i] : node_index) {
+    degree[i] = static_cast<int>(incident[i].size());
+    position[i] = p;
+  }
+  std::vector<bool> removed(kept.size(), false);
+  std::vector<int> leaves;
+  for (std::size_t i = 0; i < degree.size(); ++i) {
+    if (degree[i] == 1 && pin_vertex_.count(position[i]) == 0) {
+      leaves.push_back(static_cast<int>(i));
+    }
+  }
+  while (!leaves.empty()) {
+    const int leaf = leaves.back();
+    leaves.pop_back();
+    for (int i : incident[leaf]) {
+      if (removed[i]) {
+        continue;
+      }
+      removed[i] = true;
+      const int other = ends[i].first == leaf ? ends[i].second : ends[i].first;
+      --degree[leaf];
+      if (--degree[other] == 1 && pin_vertex_.count(position[other]) == 0) {
+        leaves.push_back(other);
+      }
+    }
+  }
+
+  std::vector<graph::Edge_i> edges;
+  for (std::size_t i = 0; i < kept.size(); ++i) {
+    if (!removed[i]) {
+      edges.push_back(kept[i]);
+    }
+  }
+  return edges;
+}
+
+int IncrementalNet::NewVertex(const graph::Node_i& position) {
+  int v;
+  if (free_vertices_.empty()) {
+    v = static_cast<int>(vertices_.size());
+    vertices_.emplace_back();
+  } else {
+    v = free_vertices_.back();
+    free_vertices_.pop_back();
+  }
+  Vertex& vertex = vertices_[v];
+  vertex.position = position;
+  vertex.num_pins = 0;
+  vertex.alive = true;
+  vertex.adjacent.clear();
+  return v;
+}
+
+void IncrementalNet::DeleteVertex(int v) {
+  while (!vertices_[v].adjacent.empty()) {
+    RemoveEdge(v, vertices_[v].adjacent.back());
+  }
+  vertices_[v].alive = false;
+  free_vertices_.push_back(v);
+}
+
+void IncrementalNet::AddEdge(int a, int b) {
+  vertices_[a].adjacent.push_back(b);
+  vertices_[b].adjacent.push_back(a);
+  length_ += Distance(vertices_[a].position, vertices_[b].position);
+}
+
+void IncrementalNet::RemoveEdge(int a, int b) {
+  auto unlink = [this](int from, int to) {
+    std::vector<int>& adjacent = vertices_[from].adjacent;
+    adjacent.erase(std::find(adjacent.begin(), adjacent.end(), to));
+  };
+  unlink(a, b);
+  unlink(b, a);
+  length_ -= Distance(vertices_[a].position, vertices_[b].position);
+}
+
+void IncrementalNet::Insert(const graph::Node_i& pin) {
+  auto [it, inserted] = pin_vertex_.emplace(pin, -1);
+  if (!inserted) {
+    ++vertices_[it->second].num_pins;
+    return;
+  }
+
+  // Find the point of the tree nearest to the pin: on a branch, the corner of
+  // its L shape that the pin is closest to. Every branch is tried, so this is
+  // linear in the size of the tree.
+  int best_a = -1;
+  int best_b = -1;
+  graph::Node_i best_point;
+  long long best_distance = -1;
+  for (std::size_t a = 0; a < vertices_.size(); ++a) {
+    const Vertex& vertex = vertices_[a];
+    if (!vertex.alive) {
+      continue;
+    }
+    if (vertex.adjacent.empty()) {
+      // The tree is this single vertex.
+      best_a = static_cast<int>(a);
+      best_point = vertex.position;
+      best_distance = Distance(pin, vertex.position);
+    }
+    for (int b : vertex.adjacent) {
+      if (b < static_cast<int>(a)) {
+        continue;
+      }
+      const graph::Node_i& p = vertex.position;
+      const graph::Node_i& q = vertices_[b].position;
+      graph::Node_i point(std::clamp(pin.x, std::min(p.x, q.x),
+                                     std::max(p.x, q.x)),
+                          std::clamp(pin.y, std::min(p.y, q.y),
+                                     std::max(p.y, q.y)));
+      const long long distance = Distance(pin, point);
+      if (best_distance < 0 || distance < best_distance) {
+        best_a = static_cast<int>(a);
+        best_b = b;
+        best_point = point;
+        best_distance = distance;
+      }
+    }
+  }
+
+  int v;
+  if (best_a < 0) {
+    v = NewVertex(pin);
+  } else {
+    // Attach the pin there, splitting the branch if needed; the split keeps
+    // its length.
+    int attach;
+    if (best_point == vertices_[best_a].position) {
+      attach = best_a;
+    } else if (best_point == vertices_[best_b].position) {
+      attach = best_b;
+    } else {
+      attach = NewVertex(best_point);
+      RemoveEdge(best_a, best_b);
+      AddEdge(best_a, attach);
+      AddEdge(attach, best_b);
+    }
+    if (best_point == pin) {
+      v = attach;
+    } else {
+      v = NewVertex(pin);
+      AddEdge(attach, v);
+    }
+  }
+  it->second = v;
+  vertices_[v].num_pins = 1;
+  Repair(v);
+}
+
+bool IncrementalNet::Erase(const graph::Node_i& pin) {
+  auto it = pin_vertex_.find(pin);
+  if (it == pin_vertex_.end()) {
+    return false;
+  }
+  const int v = it->second;
+  if (--vertices_[v].num_pins > 0) {
+    return true;
+  }
+  pin_vertex_.erase(it);
+  const int rest = Prune(v);
+  if (rest >= 0) {
+    Repair(rest);
+  }
+  return true;
+}
+
+int IncrementalNet::Prune(int v) {
+  while (vertices_[v].num_pins == 0) {
+    const std::vector<int>& adjacent = vertices_[v].adjacent;
+    if (adjacent.size() == 0) {
+      DeleteVertex(v);
+      return -1;
+    } else if (adjacent.size() == 1) {
+      const int next = adjacent[0];
+      DeleteVertex(v);
+      v = next;
+    } else if (adjacent.size() == 2) {
+      const int a = adjacent[0];
+      const int b = adjacent[1];
+      DeleteVertex(v);
+      AddEdge(a, b);
+      return a;
+    } else {
+      break;
+    }
+  }
+  return v;
+}
+
+void IncrementalNet::Repair(int center) {
+  // The region: the vertices nearest to the center, in hops.
+  std::vector<int> region = {center};
+  std::unordered_set<int> in_region = {center};
+  for (std::size_t i = 0; i < region.size() && region.size() < kRepairSize;
+       ++i) {
+    for (int w : vertices_[region[i]].adjacent) {
+      if (region.size() < kRepairSize && in_region.insert(w).second) {
+        region.push_back(w);
+      }
+    }
+  }
+
+  // Its terminals are its pins and the vertices where the rest of the tree
+  // hangs off it. Terminals at the same position are joined to one of them.
+  std::unordered_map<graph::Node_i, int> terminals;
+  std::vector<std::pair<int, int>> joined;
+  std::vector<int> x, y;
+  long long old_length = 0;
+  for (int v : region) {
+    bool terminal = vertices_[v].num_pins > 0;
+    for (int w : vertices_[v].adjacent) {
+      if (in_region.count(w) == 0) {
+        terminal = true;
+      } else if (v < w) {
+        old_length += Distance(vertices_[v].position, vertices_[w].position);
+      }
+    }
+    if (!terminal) {
+      continue;
+    }
+    const graph::Node_i& p = vertices_[v].position;
+    auto [it, inserted] = terminals.emplace(p, v);
+    if (inserted) {
+      x.push_back(p.x);
+      y.push_back(p.y);
+    } else {
+      joined.emplace_back(it->second, v);
+    }
+  }
+  if (x.size() < 2 && joined.empty()) {
+    return;
+  }
+
+  Flute::Tree tree;
+  tree.deg = 0;
+  tree.length = 0;
+  if (x.size() >= 2) {
+    tree = Flute::flute(static_cast<int>(x.size()), x.data(), y.data(),
+                        kAccuracy);
+  }
+  if (Flute::wirelength(tree) >= old_length) {
+    if (tree.deg > 0) {
+      Flute::free_tree(tree);
+    }
+    return;
+  }
+
+  // Replace the region by the tree.
+  for (int v : region) {
+    std::vector<int> adjacent = vertices_[v].adjacent;
+    for (int w : adjacent) {
+      if (v < w && in_region.count(w) > 0) {
+        RemoveEdge(v, w);
+      }
+    }
+  }
+  std::vector<int> steiner_points;
+  for (int v : region) {
+    auto it = terminals.find(vertices_[v].position);
+    if (it == terminals.end() || it->second != v) {
+      if (vertices_[v].num_pins == 0 && vertices_[v].adjacent.empty()) {
+        DeleteVertex(v);
+      } else {
+        steiner_points.push_back(v);
+      }
+    }
+  }
+  for (const auto& [a, b] : joined) {
+    AddEdge(a, b);
+  }
+  if (tree.deg > 0) {
+    std::vector<int> added = AddTree(tree, terminals);
+    steiner_points.insert(steiner_points.end(), added.begin(), added.end());
+    Flute::free_tree(tree);
+  }
+  for (const auto& [p, v] : terminals) {
+    steiner_points.push_back(v);
+  }
+  for (int v : steiner_points) {
+    if (vertices_[v].alive) {
+      Prune(v);
+    }
+  }
+}
+
+std::vector<int> IncrementalNet::AddTree(
+    const Flute::Tree& tree,
+    const std::unordered_map<graph::Node_i, int>& terminals) {
+  const int num_points = 2 * tree.deg - 2;
+  std::vector<int> vertex(num_points);
+  std::vector<int> added;
+  std::unordered_map<graph::Node_i, int> steiner_vertex;
+  for (int i = 0; i < num_points; ++i) {
+    const graph::Node_i p(tree.branch[i].x, tree.branch[i].y);
+    auto it = terminals.find(p);
+    if (it != terminals.end()) {
+      vertex[i] = it->second;
+      continue;
+    }
+    auto [steiner, inserted] = steiner_vertex.emplace(p, 0);
+    if (inserted) {
+      steiner->second = NewVertex(p);
+      added.push_back(steiner->second);
+    }
+    vertex[i] = steiner->second;
+  }
+
+  // Union-find over the vertices, to leave out the branches closing a cycle.
+  std::vector<int> parent(vertices_.size());
+  std::iota(parent.begin(), parent.end(), 0);
+  auto find = [&parent](int v) {
+    while (parent[v] != v) {
+      v = parent[v] = parent[parent[v]];
+    }
+    return v;
+  };
+  for (int i = 0; i < num_points; ++i) {
+    const int a = find(vertex[i]);
+    const int b = find(vertex[tree.branch[i].n]);
+    if (a != b) {
+      parent[a] = b;
+      AddEdge(vertex[i], vertex[tree.branch[i].n]);
+    }
+  }
+  return added;
+}
+
+void IncrementalNet::SolveFull() {
+  std::vector<std::pair<graph::Node_i, int>> pins;
+  pins.reserve(pin_vertex_.size());
+  for (const auto& [pin, v] : pin_vertex_) {
+    pins.emplace_back(pin, vertices_[v].num_pins);
+  }
+  vertices_.clear();
+  free_vertices_.clear();
+  pin_vertex_.clear();
+  length_ = 0;
+
+  std::vector<int> x, y;
+  x.reserve(pins.size());
+  y.reserve(pins.size());
+  for (const auto& [pin, num_pins] : pins) {
+    const int v = NewVertex(pin);
+    vertices_[v].num_pins = num_pins;
+    pin_vertex_.emplace(pin, v);
+    x.push_back(pin.x);
+    y.push_back(pin.y);
+  }
+  if (pins.size() >= 2) {
+    Flute::Tree tree = Flute::flute(static_cast<int>(pins.size()), x.data(),
+                                    y.data(), kAccuracy);
+    for (int v : AddTree(tree, pin_vertex_)) {
+      if (vertices_[v].alive) {
+        Prune(v);
+      }
+    }
+    Flute::free_tree(tree);
+  }
+
+  reference_length_ = length_;
+  reference_half_perimeter_ = HalfPerimeter();
+  ++num_full_solves_;
+}
+
+void IncrementalNet::CheckDegradation() {
+  const long long half_perimeter = HalfPerimeter();
+  const double expected =
+      reference_half_perimeter_ > 0
+          ? static_cast<double>(reference_length_) * half_perimeter /
+                reference_half_perimeter_
+          : static_cast<double>(half_perimeter);
+  if (static_cast<double>(length_) > (1 + max_degradation_) * expected) {
+    SolveFull();
+  } else {
+    ++num_local_updates_;
+  }
+}
+
+long long IncrementalNet::HalfPerimeter() const {
+  if (pin_vertex_.empty()) {
+    return 0;
+  }
+  graph::Boundary_i box(pin_vertex_.begin()->first.x,
+                        pin_vertex_.begin()->first.y,
+                        pin_vertex_.begin()->first.x,
+                        pin_vertex_.begin()->first.y);
+  for (const auto& [pin, v] : pin_vertex_) {
+    box.xl = std::min(box.xl, pin.x);
+    box.yl = std::min(box.yl, pin.y);
+    box.xh = std::max(box.xh, pin.x);
+    box.yh = std::max(box.yh, pin.y);
+  }
+  return static_cast<long long>(box.xh) - box.xl +
+         static_cast<long long>(box.yh) - box.yl;
+}
+
+}  // namespace steiner
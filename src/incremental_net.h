@@ -0,0 +1,130 @@
+/*******************************************************************************
+ * Feel free to use, modify, and/or distribute this code as you see fit.
+ ******************************************************************************/
+#ifndef INCREMENTAL_NET_H_
+#define INCREMENTAL_NET_H_
+
+#include <unordered_map>
+#include <vector>
+
+#include "flute.h"
+#include "graph.h"
+
+namespace steiner {
+
+// Incremental net.
+// Keeps the Steiner tree of a net up to date while its pins are added,
+// removed and moved a few at a time, without solving the net again after each
+// change. A new pin is connected to the nearest point of the tree and a
+// removed one is pruned from it; then the part of the tree around the change
+// is solved again with FLUTE, with the nodes where it meets the rest of the
+// tree as extra pins, and replaced if that is shorter.
+// Local repairs drift away from what a full solve would give. Once the tree is
+// longer than `max_degradation` (a fraction) above its expected length, the
+// length of the last full solve scaled by how much the half-perimeter of the
+// pins has changed since, the net is solved again from scratch.
+// Several pins may share a position; each of them has to be removed. Adding or
+// moving a pin looks for the nearest point among all the branches, so it takes
+// time linear in the size of the tree, on top of the repair.
+class IncrementalNet {
+ public:
+  // Constructors and destructor.
+  IncrementalNet(const graph::Boundary_i& boundary,
+                 const std::vector<graph::Node_i>& pins,
+                 double max_degradation = 0.05);
+  IncrementalNet(const IncrementalNet&) = delete;
+  IncrementalNet& operator=(const IncrementalNet&) = delete;
+  IncrementalNet(IncrementalNet&&) = default;
+  IncrementalNet& operator=(IncrementalNet&&) = default;
+  ~IncrementalNet() = default;
+
+  // Adds a pin at `pin`.
+  void AddPin(const graph::Node_i& pin);
+
+  // Removes a pin at `pin`. Returns false if there is none.
+  bool RemovePin(const graph::Node_i& pin);
+
+  // Moves a pin from `from` to `to`. Returns false if there is none at `from`.
+  bool MovePin(const graph::Node_i& from, const graph::Node_i& to);
+
+  // Returns the length of the tree, kept up to date with each change: the sum
+  // of the rectilinear distances between the nodes it connects. This is an
+  // upper bound on the length of Edges(), which is shorter where the L shapes
+  // of branches overlap.
+  long long wirelength() const { return length_; }
+
+  // Returns the edges of the tree, embedded as SteinerTreeBuilder::Solve()
+  // embeds its trees.
+  std::vector<graph::Edge_i> Edges() const;
+
+  // Returns the number of pins, counting each shared position once.
+  int num_pins() const { return static_cast<int>(pin_vertex_.size()); }
+
+  // Returns how many changes were handled by local repairs and how often the
+  // net was solved in full, including by the constructor.
+  long long num_local_updates() const { return num_local_updates_; }
+  long long num_full_solves() const { return num_full_solves_; }
+
+ private:
+  // A node of the tree: a pin, or a Steiner point if it has no pins.
+  struct Vertex {
+    graph::Node_i position;
+    int num_pins = 0;
+    bool alive = false;
+    std::vector<int> adjacent;
+  };
+
+  // Adds and removes vertices and edges, keeping the length up to date.
+  int NewVertex(const graph::Node_i& position);
+  void DeleteVertex(int v);
+  void AddEdge(int a, int b);
+  void RemoveEdge(int a, int b);
+
+  // Adds the pin or removes it, then repairs the tree around it.
+  void Insert(const graph::Node_i& pin);
+  bool Erase(const graph::Node_i& pin);
+
+  // Removes the Steiner point `v` if it is a leaf, and then its neighbor if
+  // that becomes one, or splices it out if it has two neighbors. Returns the
+  // vertex where this stopped, or -1 if the tree became empty.
+  int Prune(int v);
+
+  // Solves the part of the tree around `center` again and keeps it if it is
+  // shorter.
+  void Repair(int center);
+
+  // Adds the Steiner points and the branches of `tree`, whose pins are at the
+  // positions of `terminals`, which must be in different components. Branches
+  // that would close a cycle, which points at the same position can cause,
+  // are left out. Returns the added Steiner points.
+  std::vector<int> AddTree(
+      const Flute::Tree& tree,
+      const std::unordered_map<graph::Node_i, int>& terminals);
+
+  // Solves the net again from scratch.
+  void SolveFull();
+
+  // Solves the net from scratch if the tree is too long after a change.
+  void CheckDegradation();
+
+  // Returns the half-perimeter of the bounding box of the pins.
+  long long HalfPerimeter() const;
+
+  double max_degradation_;
+
+  std::vector<Vertex> vertices_;
+  std::vector<int> free_vertices_;                      // Reusable slots.
+  std::unordered_map<graph::Node_i, int> pin_vertex_;   // Pin to vertex.
+  long long length_ = 0;
+
+  // Length and half-perimeter at the last full solve.
+  long long reference_length_ = 0;
+  long long reference_half_perimeter_ = 0;
+
+  long long num_local_updates_ = 0;
+  long long num_full_solves_ = 0;
+};
+
+}  // namespace steiner
+
+#endif  // INCREMENTAL_NET_H_
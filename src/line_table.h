@@ -0,0 +1,67 @@
+/*******************************************************************************
+ * Feel free to use, modify, and/or distribute this code as you see fit.
+ ******************************************************************************/
+#ifndef LINE_TABLE_H_
+#define LINE_TABLE_H_
+
+#include <cstddef>
+#include <vector>
+
+#include "flat_hash_map.h"
+
+namespace steiner {
+
+// Line table.
+// Maps the rows or the columns of the plane, by coordinate, to a value. The
+// lines of a bounded range [lo, hi] are stored in a vector indexed by
+// coordinate; the others, and all of them if no range is given, in a flat hash
+// map.
+// A line that has never been accessed holds a default-constructed value.
+template <typename T>
+class LineTable {
+ public:
+  // Constructors and destructor.
+  LineTable() = default;
+  LineTable(int lo, int hi)
+      : lo_(lo),
+        dense_(hi >= lo ? std::size_t{static_cast<unsigned>(hi) -
+                                      static_cast<unsigned>(lo)} + 1
+                        : 0) {}
+  LineTable(const LineTable&) = delete;
+  LineTable& operator=(const LineTable&) = delete;
+  ~LineTable() = default;
+
+  // Returns the value of `line`, or nullptr if the line is outside the range
+  // and has never been added.
+  const T* Find(int line) const {
+    const std::size_t slot = Slot(line);
+    if (slot < dense_.size()) {
+      return &dense_[slot];
+    }
+    return sparse_.Find(line);
+  }
+
+  // Returns the value of `line`, adding it if needed.
+  T& operator[](int line) {
+    const std::size_t slot = Slot(line);
+    if (slot < dense_.size()) {
+      return dense_[slot];
+    }
+    return sparse_[line];
+  }
+
+ private:
+  // Returns the index of `line` in the vector, which is out of bounds if the
+  // line is outside the range.
+  std::size_t Slot(int line) const {
+    return static_cast<unsigned>(line) - static_cast<unsigned>(lo_);
+  }
+
+  int lo_ = 0;
+  std::vector<T> dense_;               // Lines lo_, lo_ + 1, ...
+  FlatHashMap<int, T> sparse_;         // Lines outside the vector.
+};
+
+}  // namespace steiner
+
+#endif  // LINE_TABLE_H_
@@ -1,26 +1,87 @@
 /*******************************************************************************
  * Feel free to use, modify, and/or distribute this code as you see fit.
  ******************************************************************************/
+#include <limits.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <csignal>
 #include <cstdio>
 #include <cstdlib>
 #include <iostream>
+#include <optional>
 #include <string>
 #include <string_view>
+#include <thread>
+#include <utility>
 #include <vector>
 
+#include "accuracy_scheduler.h"
 #include "file_io.h"
+#include "flute.h"
 #include "graph.h"
+#include "solver_server.h"
 #include "steiner_tree_builder.h"
+#include "thread_pool.h"
+#include "tree_cache.h"
 
-int main(int argc, char** argv) {
-  // Parse the command-line arguments.
-  if (argc != 3) {
-    std::cerr << "Usage: " << argv[0] << " <input_file> <output_file>\n";
-    return EXIT_FAILURE;
+namespace {
+
+// Maps the precompiled FLUTE LUT image installed next to the executable, if
+// there is one. Otherwise FLUTE decodes its built-in LUTs on first use. The
+// executable is found through /proc/self/exe, since `program` has no
+// directory when it was run through PATH.
+void LoadLUTImage(std::string_view program) {
+  char exe[PATH_MAX];
+  const ssize_t length = readlink("/proc/self/exe", exe, sizeof(exe));
+  std::string path = length > 0 && length < static_cast<ssize_t>(sizeof(exe))
+                         ? std::string(exe, length)
+                         : std::string(program);
+  const std::size_t slash = path.rfind('/');
+  if (slash == std::string::npos) {
+    path = ".";
+  } else {
+    path.resize(slash);
   }
-  std::string_view input_file = argv[1];
-  std::string_view output_file = argv[2];
+  path += "/" FLUTE_LUTIMAGE;
+  Flute::readLUTImage(path.c_str());
+}
+
+// Prints the command-line usage.
+void PrintUsage(const char* program) {
+  std::cerr << "Usage: " << program
+            << " <input_file> <output_file> [--threads <n>]\n"
+            << "       " << program
+            << " --multi <nets_file> <output_file> [--threads <n>]\n"
+            << "       " << program
+            << " --batch <manifest_file> [--threads <n>]\n"
+            << "       " << program
+            << " --wirelength <nets_file> <output_file> [--threads <n>]\n"
+            << "       " << program
+            << " --stream [<nets_file> [<output_file>]] [--threads <n>]\n"
+            << "       " << program << " --serve <socket_path> [--threads <n>]\n"
+            << "       " << program
+            << " --convert-nets <nets_file> <output_file> [--packed]\n"
+            << "       " << program
+            << " --convert-trees <trees_file> <output_file> [--packed]\n"
+            << "Output files ending in .bin are written in the binary format, "
+               "with packed\ncoordinates if --packed is given. The multi-net "
+               "modes cache up to <mb>\nmegabytes of trees, reused for "
+               "translated nets, if --cache <mb> is given.\n"
+            << "The solving modes choose the FLUTE accuracy of each net to "
+               "take up to <us>\nmicroseconds if --budget <us> is given, and "
+               "to be done <ms> milliseconds\nafter the start if --deadline "
+               "<ms> is given. With --anytime, every net is\nsolved at the "
+               "lowest accuracy first and upgraded with the time left.\n";
+}
 
+// Solves the single net of `input_file` and writes its tree to `output_file`.
+// With `num_threads` other than 1, a large net is split into tasks on that
+// many threads.
+int RunSingle(std::string_view input_file, std::string_view output_file,
+              int num_threads, file_io::BinaryEncoding encoding,
+              steiner::AccuracyScheduler* scheduler) {
   // Read the input file.
   graph::Boundary_i boundary;
   std::vector<graph::Node_i> nodes;
@@ -30,15 +91,321 @@ int main(int argc, char** argv) {
   }
 
   // Run the Steiner tree algorithm.
-  steiner::SteinerTreeBuilder builder;
-  const std::vector<graph::Edge_i> edges = builder.Solve(boundary, nodes);
+  steiner::SteinerTreeBuilder builder(nullptr, scheduler);
+  std::vector<graph::Edge_i> edges;
+  if (num_threads == 1) {
+    edges = builder.Solve(boundary, nodes);
+  } else {
+    steiner::ThreadPool pool(num_threads);
+    edges = builder.Solve(boundary, nodes, &pool);
+  }
+  if (scheduler != nullptr) {
+    scheduler->PrintStats(std::cerr);
+  }
 
   // Write the output file.
-  if (!file_io::WriteOutputFile(output_file, edges)) {
+  if (!file_io::WriteOutputFile(output_file, edges, encoding)) {
+    std::cerr << "Failed to write the output file: " << output_file << "\n";
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
+
+// Solves every net of the multi-net file `nets_file` and writes their trees,
+// in the same order, to `output_file`.
+int RunMulti(std::string_view nets_file, std::string_view output_file,
+             int num_threads, file_io::BinaryEncoding encoding,
+             steiner::TreeCache* cache, steiner::AccuracyScheduler* scheduler) {
+  std::vector<graph::Net_i> nets;
+  if (!file_io::ReadNetsFile(nets_file, &nets)) {
+    std::cerr << "Failed to read the nets file: " << nets_file << "\n";
+    return EXIT_FAILURE;
+  }
+
+  steiner::SteinerTreeBuilder builder(cache, scheduler);
+  const std::vector<std::vector<graph::Edge_i>> trees =
+      builder.SolveBatch(nets, num_threads);
+  if (cache != nullptr) {
+    cache->PrintStats(std::cerr);
+  }
+  if (scheduler != nullptr) {
+    scheduler->PrintStats(std::cerr);
+  }
+
+  if (!file_io::WriteTreesFile(output_file, trees, encoding)) {
     std::cerr << "Failed to write the output file: " << output_file << "\n";
     return EXIT_FAILURE;
   }
 
-  // Exit successfully.
   return EXIT_SUCCESS;
 }
+
+// Estimates the wirelength of every net of the multi-net file `nets_file`
+// without building the trees and writes the lengths, one per line in the same
+// order, to `output_file`.
+int RunWirelength(std::string_view nets_file, std::string_view output_file,
+                  int num_threads) {
+  std::vector<graph::Net_i> nets;
+  if (!file_io::ReadNetsFile(nets_file, &nets)) {
+    std::cerr << "Failed to read the nets file: " << nets_file << "\n";
+    return EXIT_FAILURE;
+  }
+
+  steiner::SteinerTreeBuilder builder;
+  const std::vector<long long> lengths =
+      builder.EstimateWirelengths(nets, num_threads);
+
+  if (!file_io::WriteLengthsFile(output_file, lengths)) {
+    std::cerr << "Failed to write the output file: " << output_file << "\n";
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
+
+// Solves the net of every input file listed in `manifest_file` and writes
+// each tree to the output file paired with it.
+int RunBatch(std::string_view manifest_file, int num_threads,
+             file_io::BinaryEncoding encoding, steiner::TreeCache* cache,
+             steiner::AccuracyScheduler* scheduler) {
+  std::vector<std::pair<std::string, std::string>> jobs;
+  if (!file_io::ReadManifestFile(manifest_file, &jobs)) {
+    std::cerr << "Failed to read the manifest file: " << manifest_file << "\n";
+    return EXIT_FAILURE;
+  }
+
+  std::vector<graph::Net_i> nets(jobs.size());
+  for (std::size_t i = 0; i < jobs.size(); ++i) {
+    if (!file_io::ReadInputFile(jobs[i].first, &nets[i].boundary,
+                                &nets[i].nodes)) {
+      std::cerr << "Failed to read the input file: " << jobs[i].first << "\n";
+      return EXIT_FAILURE;
+    }
+  }
+
+  steiner::SteinerTreeBuilder builder(cache, scheduler);
+  const std::vector<std::vector<graph::Edge_i>> trees =
+      builder.SolveBatch(nets, num_threads);
+  if (cache != nullptr) {
+    cache->PrintStats(std::cerr);
+  }
+  if (scheduler != nullptr) {
+    scheduler->PrintStats(std::cerr);
+  }
+
+  int status = EXIT_SUCCESS;
+  for (std::size_t i = 0; i < jobs.size(); ++i) {
+    if (!file_io::WriteOutputFile(jobs[i].second, trees[i], encoding)) {
+      std::cerr << "Failed to write the output file: " << jobs[i].second
+                << "\n";
+      status = EXIT_FAILURE;
+    }
+  }
+
+  return status;
+}
+
+// Solves the nets of `nets_file` as they are read and writes their trees, in
+// the same order, to `output_file` as soon as they are done. Both default to
+// "-", the standard input and output.
+int RunStream(std::string_view nets_file, std::string_view output_file,
+              int num_threads, steiner::TreeCache* cache,
+              steiner::AccuracyScheduler* scheduler) {
+  if (file_io::IsBinaryFile(output_file)) {
+    std::cerr << "The stream mode writes text only: " << output_file << "\n";
+    return EXIT_FAILURE;
+  }
+  const int in_fd = file_io::OpenInputFile(nets_file);
+  if (in_fd < 0) {
+    std::cerr << "Failed to open the nets file: " << nets_file << "\n";
+    return EXIT_FAILURE;
+  }
+  const int out_fd = file_io::OpenOutputFile(output_file);
+  if (out_fd < 0) {
+    std::cerr << "Failed to open the output file: " << output_file << "\n";
+    file_io::CloseFile(in_fd);
+    return EXIT_FAILURE;
+  }
+
+  bool ok;
+  file_io::NetReader reader(in_fd);
+  {
+    file_io::TreeWriter writer(out_fd);
+    steiner::SteinerTreeBuilder builder(cache, scheduler);
+    ok = builder.SolveStream(
+        [&reader](graph::Net_i* net) { return reader.Next(net); },
+        [&writer](std::vector<graph::Edge_i>& edges) {
+          writer.WriteTree(edges);
+          writer.Write("\n");
+          return true;
+        },
+        [&writer] { return writer.Flush(); }, num_threads);
+  }
+  file_io::CloseFile(in_fd);
+  if (cache != nullptr) {
+    cache->PrintStats(std::cerr);
+  }
+  if (scheduler != nullptr) {
+    scheduler->PrintStats(std::cerr);
+  }
+  if (!file_io::CloseFile(out_fd) || !ok) {
+    std::cerr << "Failed to write the output file: " << output_file << "\n";
+    return EXIT_FAILURE;
+  }
+  if (!reader.ok()) {
+    std::cerr << "Failed to read the nets file: " << nets_file << "\n";
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
+
+// Runs the solver daemon on `socket_path` until SIGINT or SIGTERM, printing
+// its statistics on SIGUSR1 and on exit.
+int RunServe(const std::string& socket_path, int num_threads,
+             steiner::TreeCache* cache, steiner::AccuracyScheduler* scheduler) {
+  // Decode every LUT up front, so that no request pays for it.
+  Flute::ensureLUT(FLUTE_D);
+
+  // The signals are taken by a dedicated thread; the other threads, created
+  // below, inherit the mask. A client that disconnects early must not kill
+  // the daemon.
+  sigset_t signals;
+  sigemptyset(&signals);
+  sigaddset(&signals, SIGINT);
+  sigaddset(&signals, SIGTERM);
+  sigaddset(&signals, SIGUSR1);
+  pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+  std::signal(SIGPIPE, SIG_IGN);
+
+  steiner::SolverServer server(num_threads, cache, scheduler);
+  std::thread signal_thread([&server, &signals] {
+    int signal = 0;
+    while (sigwait(&signals, &signal) == 0 && signal == SIGUSR1) {
+      server.PrintStats(std::cerr);
+    }
+    server.Stop();
+  });
+
+  const bool ok = server.Serve(socket_path);
+  pthread_kill(signal_thread.native_handle(), SIGTERM);
+  signal_thread.join();
+  server.PrintStats(std::cerr);
+
+  return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+// Converts the multi-net file `nets_file` between the text and binary formats.
+int RunConvertNets(std::string_view nets_file, std::string_view output_file,
+                   file_io::BinaryEncoding encoding) {
+  std::vector<graph::Net_i> nets;
+  if (!file_io::ReadNetsFile(nets_file, &nets)) {
+    std::cerr << "Failed to read the nets file: " << nets_file << "\n";
+    return EXIT_FAILURE;
+  }
+  if (!file_io::WriteNetsFile(output_file, nets, encoding)) {
+    std::cerr << "Failed to write the output file: " << output_file << "\n";
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
+
+// Converts the multi-tree file `trees_file` between the text and binary
+// formats.
+int RunConvertTrees(std::string_view trees_file, std::string_view output_file,
+                    file_io::BinaryEncoding encoding) {
+  std::vector<std::vector<graph::Edge_i>> trees;
+  if (!file_io::ReadTreesFile(trees_file, &trees)) {
+    std::cerr << "Failed to read the trees file: " << trees_file << "\n";
+    return EXIT_FAILURE;
+  }
+  if (!file_io::WriteTreesFile(output_file, trees, encoding)) {
+    std::cerr << "Failed to write the output file: " << output_file << "\n";
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  // Parse the command-line arguments.
+  std::vector<std::string_view> args;
+  // The batch modes use every hardware thread by default, a single net is
+  // solved serially unless --threads is given.
+  std::optional<int> num_threads;
+  file_io::BinaryEncoding encoding = file_io::BinaryEncoding::kDeltaVarint;
+  std::optional<steiner::TreeCache> cache;
+  std::optional<long long> budget_us;
+  std::optional<long long> deadline_ms;
+  bool anytime = false;
+  for (int i = 1; i < argc; ++i) {
+    std::string_view arg = argv[i];
+    if (arg == "--threads" && i + 1 < argc) {
+      num_threads = std::atoi(argv[++i]);
+    } else if (arg == "--cache" && i + 1 < argc) {
+      cache.emplace(std::strtoull(argv[++i], nullptr, 10) << 20);
+    } else if (arg == "--budget" && i + 1 < argc) {
+      budget_us = std::atoll(argv[++i]);
+    } else if (arg == "--deadline" && i + 1 < argc) {
+      deadline_ms = std::atoll(argv[++i]);
+    } else if (arg == "--anytime") {
+      anytime = true;
+    } else if (arg == "--packed") {
+      encoding = file_io::BinaryEncoding::kPacked;
+    } else {
+      args.push_back(arg);
+    }
+  }
+
+  if (args.size() == 3 && args[0] == "--convert-nets") {
+    return RunConvertNets(args[1], args[2], encoding);
+  }
+  if (args.size() == 3 && args[0] == "--convert-trees") {
+    return RunConvertTrees(args[1], args[2], encoding);
+  }
+
+  LoadLUTImage(argv[0]);
+  steiner::TreeCache* cache_ptr = cache ? &*cache : nullptr;
+
+  // The deadline counts from here, including the time to read the input.
+  std::optional<steiner::AccuracyScheduler> scheduler;
+  if (budget_us || deadline_ms || anytime) {
+    using Clock = steiner::AccuracyScheduler::Clock;
+    scheduler.emplace(
+        std::chrono::microseconds(budget_us.value_or(0)),
+        deadline_ms ? Clock::now() + std::chrono::milliseconds(*deadline_ms)
+                    : Clock::time_point::max(),
+        anytime);
+  }
+  steiner::AccuracyScheduler* scheduler_ptr = scheduler ? &*scheduler : nullptr;
+
+  if (args.size() == 3 && args[0] == "--multi") {
+    return RunMulti(args[1], args[2], num_threads.value_or(0), encoding,
+                    cache_ptr, scheduler_ptr);
+  }
+  if (args.size() == 3 && args[0] == "--wirelength") {
+    return RunWirelength(args[1], args[2], num_threads.value_or(0));
+  }
+  if (!args.empty() && args.size() <= 3 && args[0] == "--stream") {
+    return RunStream(args.size() > 1 ? args[1] : "-",
+                     args.size() > 2 ? args[2] : "-", num_threads.value_or(0),
+                     cache_ptr, scheduler_ptr);
+  }
+  if (args.size() == 2 && args[0] == "--serve") {
+    return RunServe(std::string(args[1]), num_threads.value_or(0), cache_ptr,
+                    scheduler_ptr);
+  }
+  if (args.size() == 2 && args[0] == "--batch") {
+    return RunBatch(args[1], num_threads.value_or(0), encoding, cache_ptr,
+                    scheduler_ptr);
+  }
+  if (args.size() == 2 && args[0].substr(0, 2) != "--") {
+    return RunSingle(args[0], args[1], num_threads.value_or(1), encoding,
+                     scheduler_ptr);
+  }
+
+  PrintUsage(argv[0]);
+  return EXIT_FAILURE;
+}
@@ -0,0 +1,80 @@
+/*******************************************************************************
+ * Feel free to use, modify, and/or distribute this code as you see fit.
+ ******************************************************************************/
+#include "node_index.h"
+
+#include <algorithm>
+#include <vector>
+
+#include "graph.h"
+#include "line_table.h"
+
+namespace steiner {
+
+namespace {
+
+// Inserts `pos` into the sorted vector `line` unless it is already there.
+void InsertSorted(std::vector<int>* line, int pos) {
+  auto it = std::lower_bound(line->begin(), line->end(), pos);
+  if (it == line->end() || *it != pos) {
+    line->insert(it, pos);
+  }
+}
+
+}  // namespace
+
+void NodeIndex::Insert(const graph::Node_i& node) {
+  InsertSorted(&rows_[node.y], node.x);
+  InsertSorted(&cols_[node.x], node.y);
+}
+
+bool NodeIndex::Contains(const graph::Node_i& node) const {
+  const std::vector<int>* row = rows_.Find(node.y);
+  return row != nullptr &&
+         std::binary_search(row->begin(), row->end(), node.x);
+}
+
+NodeIndex::Range NodeIndex::RowRange(int y, int lo, int hi) const {
+  return FindRange(rows_, y, lo, hi);
+}
+
+NodeIndex::Range NodeIndex::ColumnRange(int x, int lo, int hi) const {
+  return FindRange(cols_, x, lo, hi);
+}
+
+NodeIndex::Range NodeIndex::FindRange(const LineTable<std::vector<int>>& lines,
+                                      int line, int lo, int hi) {
+  if (lo >= hi) {
+    return {nullptr, nullptr};
+  }
+  const std::vector<int>* found = lines.Find(line);
+  if (found == nullptr) {
+    return {nullptr, nullptr};
+  }
+  const std::vector<int>& positions = *found;
+  const int* first = positions.data();
+  const int* last = first + positions.size();
+  const int* begin = std::upper_bound(first, last, lo);
+  const int* end = std::lower_bound(begin, last, hi);
+  return {begin, end};
+}
+
+std::vector<graph::Node_i> NodeIndex::NodesBetween(
+    const graph::Node_i& a, const graph::Node_i& b) const {
+  std::vector<graph::Node_i> nodes_between;
+  if (a.y == b.y) {
+    auto [begin, end] = RowRange(a.y, std::min(a.x, b.x), std::max(a.x, b.x));
+    for (const int* x = begin; x != end; ++x) {
+      nodes_between.emplace_back(*x, a.y);
+    }
+  } else if (a.x == b.x) {
+    auto [begin, end] =
+        ColumnRange(a.x, std::min(a.y, b.y), std::max(a.y, b.y));
+    for (const int* y = begin; y != end; ++y) {
+      nodes_between.emplace_back(a.x, *y);
+    }
+  }
+  return nodes_between;
+}
+
+}  // namespace steiner
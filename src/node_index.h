@@ -0,0 +1,62 @@
+/*******************************************************************************
+ * Feel free to use, modify, and/or distribute this code as you see fit.
+ ******************************************************************************/
+#ifndef NODE_INDEX_H_
+#define NODE_INDEX_H_
+
+#include <utility>
+#include <vector>
+
+#include "graph.h"
+#include "line_table.h"
+
+namespace steiner {
+
+// Node index.
+// Keeps the x-coordinates of the nodes on every row and the y-coordinates of
+// the nodes on every column in sorted vectors, so that the nodes lying on an
+// axis-aligned segment are found by a binary search whose cost depends on the
+// number of hits rather than on the length of the segment. The lines within a
+// bounding box, if one is given, are indexed directly by coordinate.
+class NodeIndex {
+ public:
+  // A half-open range [first, second) of sorted positions along a line.
+  using Range = std::pair<const int*, const int*>;
+
+  // Constructors and destructor.
+  NodeIndex() = default;
+  explicit NodeIndex(const graph::Boundary_i& box)
+      : rows_(box.yl, box.yh), cols_(box.xl, box.xh) {}
+  NodeIndex(const NodeIndex&) = delete;
+  NodeIndex& operator=(const NodeIndex&) = delete;
+  ~NodeIndex() = default;
+
+  // Adds a node. Adding a node twice has no effect.
+  void Insert(const graph::Node_i& node);
+
+  // Returns true if the node has been added.
+  bool Contains(const graph::Node_i& node) const;
+
+  // Returns the x-coordinates of the nodes on row y strictly between lo and hi.
+  Range RowRange(int y, int lo, int hi) const;
+
+  // Returns the y-coordinates of the nodes on column x strictly between lo and
+  // hi.
+  Range ColumnRange(int x, int lo, int hi) const;
+
+  // Returns the nodes strictly between the ends of the axis-aligned segment
+  // (a, b), in increasing order. The order of a and b does not matter.
+  std::vector<graph::Node_i> NodesBetween(const graph::Node_i& a,
+                                          const graph::Node_i& b) const;
+
+ private:
+  static Range FindRange(const LineTable<std::vector<int>>& lines, int line,
+                         int lo, int hi);
+
+  LineTable<std::vector<int>> rows_;  // y -> sorted x.
+  LineTable<std::vector<int>> cols_;  // x -> sorted y.
+};
+
+}  // namespace steiner
+
+#endif  // NODE_INDEX_H_
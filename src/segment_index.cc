@@ -0,0 +1,95 @@
+/*******************************************************************************
+ * Feel free to use, modify, and/or distribute this code as you see fit.
+ ******************************************************************************/
+#include "segment_index.h"
+
+#include <algorithm>
+#include <iterator>
+#include <utility>
+#include <vector>
+
+#include "graph.h"
+#include "line_table.h"
+
+namespace steiner {
+
+void SegmentIndex::FindGaps(const IntervalMap* intervals, int lo, int hi,
+                            std::vector<std::pair<int, int>>* gaps) {
+  int curr = lo;
+  if (intervals != nullptr) {
+    // At most one stored segment starts at or before `lo` and covers it.
+    auto it = intervals->upper_bound(lo);
+    if (it != intervals->begin()) {
+      curr = std::max(curr, std::prev(it)->second);
+    }
+    for (; it != intervals->end() && it->first < hi; ++it) {
+      if (it->first > curr) {
+        gaps->emplace_back(curr, it->first);
+      }
+      curr = std::max(curr, it->second);
+    }
+  }
+  if (curr < hi) {
+    gaps->emplace_back(curr, hi);
+  }
+}
+
+std::vector<SegmentIndex::Segment> SegmentIndex::Resolve(
+    const graph::Node_i& a, const graph::Node_i& b) const {
+  const graph::Node_i p1 = std::min(a, b);
+  const graph::Node_i p2 = std::max(a, b);
+  if (p1.x != p2.x && p1.y != p2.y) {
+    // Not axis aligned, return as is.
+    return {std::make_pair(p1, p2)};
+  }
+
+  // A degenerate segment is treated as vertical, it never yields a part.
+  const bool horizontal = p1.y == p2.y && p1.x != p2.x;
+  const int line = horizontal ? p1.y : p1.x;
+  const int lo = horizontal ? p1.x : p1.y;
+  const int hi = horizontal ? p2.x : p2.y;
+  auto make_node = [horizontal, line](int pos) {
+    return horizontal ? graph::Node_i(pos, line) : graph::Node_i(line, pos);
+  };
+
+  // Remove the parts covered by stored segments on the same line.
+  std::vector<std::pair<int, int>> gaps;
+  FindGaps((horizontal ? rows_ : cols_).Find(line), lo, hi, &gaps);
+
+  // Split the remaining parts at the nodes strictly inside them.
+  std::vector<Segment> parts;
+  for (const auto& [gap_lo, gap_hi] : gaps) {
+    auto [begin, end] = horizontal ? nodes_.RowRange(line, gap_lo, gap_hi)
+                                   : nodes_.ColumnRange(line, gap_lo, gap_hi);
+    int last = gap_lo;
+    for (const int* pos = begin; pos != end; ++pos) {
+      parts.emplace_back(make_node(last), make_node(*pos));
+      last = *pos;
+    }
+    parts.emplace_back(make_node(last), make_node(gap_hi));
+  }
+  return parts;
+}
+
+bool SegmentIndex::IsCovered(const graph::Node_i& a,
+                             const graph::Node_i& b) const {
+  const graph::Node_i p1 = std::min(a, b);
+  const graph::Node_i p2 = std::max(a, b);
+  std::vector<std::pair<int, int>> gaps;
+  if (p1.y == p2.y) {
+    FindGaps(rows_.Find(p1.y), p1.x, p2.x, &gaps);
+  } else {
+    FindGaps(cols_.Find(p1.x), p1.y, p2.y, &gaps);
+  }
+  return gaps.empty();
+}
+
+bool SegmentIndex::Insert(const Segment& segment) {
+  const auto& [p1, p2] = segment;
+  if (p1.y == p2.y) {
+    return rows_[p1.y].emplace(p1.x, p2.x).second;
+  }
+  return cols_[p1.x].emplace(p1.y, p2.y).second;
+}
+
+}  // namespace steiner
@@ -0,0 +1,73 @@
+/*******************************************************************************
+ * Feel free to use, modify, and/or distribute this code as you see fit.
+ ******************************************************************************/
+#ifndef SEGMENT_INDEX_H_
+#define SEGMENT_INDEX_H_
+
+#include <map>
+#include <utility>
+#include <vector>
+
+#include "graph.h"
+#include "line_table.h"
+#include "node_index.h"
+
+namespace steiner {
+
+// Segment index.
+// Stores the axis-aligned segments of a tree under construction in per-row
+// and per-column interval maps, together with the tree nodes lying on each
+// row and column. Overlap removal, coverage tests and splitting at
+// intermediate nodes are answered with ordered lookups on a single line
+// instead of scanning every stored segment and node.
+class SegmentIndex {
+ public:
+  // A segment is a pair of nodes in canonical (lexicographic) order.
+  using Segment = std::pair<graph::Node_i, graph::Node_i>;
+
+  // Constructors and destructor.
+  SegmentIndex() = default;
+  // An index whose lines within `box` are indexed directly by coordinate.
+  explicit SegmentIndex(const graph::Boundary_i& box)
+      : rows_(box.yl, box.yh), cols_(box.xl, box.xh), nodes_(box) {}
+  SegmentIndex(const SegmentIndex&) = delete;
+  SegmentIndex& operator=(const SegmentIndex&) = delete;
+  ~SegmentIndex() = default;
+
+  // Registers a tree node. Resolved segments are split at registered nodes.
+  void AddNode(const graph::Node_i& node) { nodes_.Insert(node); }
+
+  // Returns the registered nodes.
+  const NodeIndex& nodes() const { return nodes_; }
+
+  // Returns the parts of segment (a, b) not covered by stored segments, split
+  // at registered nodes strictly inside them, in increasing order along the
+  // line. A segment that is not axis-aligned is returned as is.
+  std::vector<Segment> Resolve(const graph::Node_i& a,
+                               const graph::Node_i& b) const;
+
+  // Returns true if the axis-aligned segment (a, b) is entirely covered by
+  // stored segments.
+  bool IsCovered(const graph::Node_i& a, const graph::Node_i& b) const;
+
+  // Stores a segment returned by Resolve(). Returns false if the segment is
+  // already stored.
+  bool Insert(const Segment& segment);
+
+ private:
+  // Segments on one line, keyed by their lower end, mapped to their upper end.
+  // Stored segments never overlap, although they may share an end.
+  using IntervalMap = std::map<int, int>;
+
+  // Appends the gaps of [lo, hi] not covered by `intervals` to `gaps`.
+  static void FindGaps(const IntervalMap* intervals, int lo, int hi,
+                       std::vector<std::pair<int, int>>* gaps);
+
+  LineTable<IntervalMap> rows_;  // y -> horizontal segments.
+  LineTable<IntervalMap> cols_;  // x -> vertical segments.
+  NodeIndex nodes_;              // Registered nodes.
+};
+
+}  // namespace steiner
+
+#endif  // SEGMENT_INDEX_H_
@@ -0,0 +1,231 @@
+/*******************************************************************************
+ * Feel free to use, modify, and/or distribute this code as you see fit.
+ ******************************************************************************/
+#include "solver_server.h"
+
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "accuracy_scheduler.h"
+#include "file_io.h"
+#include "graph.h"
+#include "thread_pool.h"
+#include "tree_cache.h"
+
+namespace steiner {
+
+SolverServer::SolverServer(int num_threads, TreeCache* cache,
+                           AccuracyScheduler* scheduler)
+    : pool_(num_threads),
+      cache_(cache),
+      scheduler_(scheduler),
+      builder_(cache, scheduler) {}
+
+bool SolverServer::Serve(const std::string& socket_path) {
+  sockaddr_un address = {};
+  address.sun_family = AF_UNIX;
+  if (socket_path.size() >= sizeof(address.sun_path)) {
+    std::cerr << "Socket path too long: " << socket_path << "\n";
+    return false;
+  }
+  std::memcpy(address.sun_path, socket_path.c_str(), socket_path.size() + 1);
+
+  // A socket left behind by an earlier daemon refuses connections and is
+  // replaced. One that accepts them belongs to a daemon still running.
+  struct stat st;
+  if (lstat(socket_path.c_str(), &st) == 0 && S_ISSOCK(st.st_mode)) {
+    const int probe = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (probe < 0) {
+      std::cerr << "Failed to create a socket: " << std::strerror(errno)
+                << "\n";
+      return false;
+    }
+    const bool in_use =
+        connect(probe, reinterpret_cast<const sockaddr*>(&address),
+                sizeof(address)) == 0;
+    const int connect_errno = errno;
+    close(probe);
+    if (in_use) {
+      std::cerr << "Socket " << socket_path
+                << " is already in use by another daemon\n";
+      return false;
+    }
+    if (connect_errno == ECONNREFUSED) {
+      unlink(socket_path.c_str());
+    }
+  }
+
+  const int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd < 0 ||
+      bind(fd, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) <
+          0 ||
+      listen(fd, SOMAXCONN) < 0) {
+    std::cerr << "Failed to listen on " << socket_path << ": "
+              << std::strerror(errno) << "\n";
+    if (fd >= 0) {
+      close(fd);
+    }
+    return false;
+  }
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (stopping_) {
+      close(fd);
+      unlink(socket_path.c_str());
+      return true;
+    }
+    listen_fd_ = fd;
+  }
+
+  while (true) {
+    const int client_fd = accept4(fd, nullptr, nullptr, SOCK_CLOEXEC);
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (stopping_) {
+      if (client_fd >= 0) {
+        close(client_fd);
+      }
+      break;
+    }
+    if (client_fd < 0) {
+      if (errno == EINTR || errno == ECONNABORTED) {
+        continue;
+      }
+      std::cerr << "Failed to accept a client: " << std::strerror(errno)
+                << "\n";
+      stopping_ = true;
+      break;
+    }
+    client_fds_.insert(client_fd);
+    std::thread(&SolverServer::ServeClient, this, client_fd).detach();
+  }
+
+  // Disconnect the clients and wait for their threads.
+  std::unique_lock<std::mutex> lock(mutex_);
+  for (int client_fd : client_fds_) {
+    shutdown(client_fd, SHUT_RDWR);
+  }
+  clients_done_.wait(lock, [this] { return client_fds_.empty(); });
+  listen_fd_ = -1;
+  close(fd);
+  unlink(socket_path.c_str());
+  return true;
+}
+
+void SolverServer::Stop() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  stopping_ = true;
+  if (listen_fd_ >= 0) {
+    // Wakes up the accept() of Serve().
+    shutdown(listen_fd_, SHUT_RDWR);
+  }
+}
+
+void SolverServer::ServeClient(int fd) {
+  file_io::NetReader reader(fd);
+  file_io::NetRequest request;
+  std::vector<std::vector<graph::Edge_i>> trees;
+  {
+    file_io::TreeWriter writer(fd);
+    while (reader.NextRequest(&request)) {
+      const auto start = std::chrono::steady_clock::now();
+
+      const std::vector<graph::Net_i>& nets = request.nets;
+      trees.resize(nets.size());
+      if (nets.size() == 1) {
+        trees[0] = builder_.Solve(nets[0].boundary, nets[0].nodes, &pool_);
+      } else {
+        TaskGroup group(&pool_);
+        for (std::size_t i = 0; i < nets.size(); ++i) {
+          group.Run([this, &nets, &trees, i] {
+            trees[i] = builder_.Solve(nets[i].boundary, nets[i].nodes, &pool_);
+          });
+        }
+        group.Wait();
+      }
+
+      if (request.binary) {
+        writer.WriteBinaryTrees(trees, request.encoding);
+      } else {
+        writer.WriteTree(trees[0]);
+        writer.Write("\n");
+      }
+      if (!writer.Flush()) {
+        break;
+      }
+      RecordRequest(nets.size(), std::chrono::steady_clock::now() - start);
+    }
+  }
+  if (!reader.ok()) {
+    std::cerr << "Closed a client after a malformed request\n";
+  }
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  close(fd);
+  client_fds_.erase(fd);
+  clients_done_.notify_all();
+}
+
+void SolverServer::RecordRequest(std::size_t num_nets,
+                                 std::chrono::nanoseconds latency) {
+  const auto micros =
+      std::chrono::duration_cast<std::chrono::microseconds>(latency).count();
+  int bucket = 0;
+  while (bucket + 1 < kNumLatencyBuckets && (micros >> bucket) > 0) {
+    ++bucket;
+  }
+
+  std::lock_guard<std::mutex> lock(stats_mutex_);
+  ++num_requests_;
+  num_nets_ += num_nets;
+  total_latency_ += latency;
+  max_latency_ = std::max(max_latency_, latency);
+  ++latency_buckets_[bucket];
+}
+
+void SolverServer::PrintStats(std::ostream& out) const {
+  if (cache_ != nullptr) {
+    cache_->PrintStats(out);
+  }
+  if (scheduler_ != nullptr) {
+    scheduler_->PrintStats(out);
+  }
+
+  std::lock_guard<std::mutex> lock(stats_mutex_);
+  out << "Requests: " << num_requests_ << " (" << num_nets_ << " nets)";
+  if (num_requests_ == 0) {
+    out << "\n";
+    return;
+  }
+
+  // Bucket i holds the latencies below 2^i us.
+  auto percentile = [this](double fraction) {
+    const double rank = fraction * static_cast<double>(num_requests_);
+    std::uint64_t count = 0;
+    int bucket = 0;
+    while (bucket + 1 < kNumLatencyBuckets &&
+           static_cast<double>(count += latency_buckets_[bucket]) < rank) {
+      ++bucket;
+    }
+    return std::uint64_t{1} << bucket;
+  };
+  const double micros = 1e-3;
+  out << ", latency mean "
+      << total_latency_.count() * micros / static_cast<double>(num_requests_)
+      << " us, p50 < " << percentile(0.5) << " us, p90 < " << percentile(0.9)
+      << " us, p99 < " << percentile(0.99) << " us, max "
+      << max_latency_.count() * micros << " us\n";
+}
+
+}  // namespace steiner
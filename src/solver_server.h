@@ -0,0 +1,90 @@
+/*******************************************************************************
+ * Feel free to use, modify, and/or distribute this code as you see fit.
+ ******************************************************************************/
+#ifndef SOLVER_SERVER_H_
+#define SOLVER_SERVER_H_
+
+#include <array>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <unordered_set>
+
+#include "accuracy_scheduler.h"
+#include "steiner_tree_builder.h"
+#include "thread_pool.h"
+#include "tree_cache.h"
+
+namespace steiner {
+
+// Solver daemon.
+// Listens on a Unix domain socket and answers the requests of any number of
+// concurrent clients, each served on its own thread. A client sends nets in
+// the input file format, each answered with its tree in the output file
+// format and a newline, or binary nets files, each answered with a binary
+// trees file. Large nets and multi-net requests are split into tasks on a
+// shared thread pool.
+class SolverServer {
+ public:
+  // Constructors and destructor.
+  // The pool has `num_threads` workers (one per hardware thread if <= 0).
+  // Trees are cached in `cache`, if given, and the accuracy of each net is
+  // chosen by `scheduler`, if given.
+  explicit SolverServer(int num_threads = 0, TreeCache* cache = nullptr,
+                        AccuracyScheduler* scheduler = nullptr);
+  SolverServer(const SolverServer&) = delete;
+  SolverServer& operator=(const SolverServer&) = delete;
+  SolverServer(SolverServer&&) = delete;
+  SolverServer& operator=(SolverServer&&) = delete;
+  ~SolverServer() = default;
+
+  // Listens on `socket_path` and serves clients until Stop() is called. A
+  // stale socket at the path is replaced. Returns false if the socket cannot
+  // be set up, e.g., if another daemon is listening on it.
+  bool Serve(const std::string& socket_path);
+
+  // Disconnects the clients and makes Serve() return. May be called from any
+  // thread.
+  void Stop();
+
+  // Prints the number of requests and the distribution of their latency, from
+  // a request being read to its answer being written, and the statistics of
+  // the cache and the scheduler.
+  void PrintStats(std::ostream& out) const;
+
+ private:
+  // Latencies are counted in buckets of powers of two microseconds.
+  static constexpr int kNumLatencyBuckets = 32;
+
+  // Serves the client connected on `fd` until it disconnects, then closes
+  // `fd`.
+  void ServeClient(int fd);
+
+  // Adds a request of `num_nets` nets to the statistics.
+  void RecordRequest(std::size_t num_nets, std::chrono::nanoseconds latency);
+
+  ThreadPool pool_;
+  TreeCache* cache_;
+  AccuracyScheduler* scheduler_;
+  SteinerTreeBuilder builder_;
+
+  std::mutex mutex_;  // Guards the state below.
+  std::condition_variable clients_done_;
+  int listen_fd_ = -1;
+  bool stopping_ = false;
+  std::unordered_set<int> client_fds_;  // Connected clients.
+
+  mutable std::mutex stats_mutex_;  // Guards the statistics below.
+  std::uint64_t num_requests_ = 0;
+  std::uint64_t num_nets_ = 0;
+  std::chrono::nanoseconds total_latency_{0};
+  std::chrono::nanoseconds max_latency_{0};
+  std::array<std::uint64_t, kNumLatencyBuckets> latency_buckets_{};
+};
+
+}  // namespace steiner
+
+#endif  // SOLVER_SERVER_H_
@@ -1,251 +1,516 @@
 #include "steiner_tree_builder.h"
 
 #include <vector>
-#include <unordered_set>
 #include <string>
 #include <cassert>
+#include <cstdlib>
 #include <tuple>
 #include <optional>
 #include <functional>
 #include <algorithm>
-
+#include <numeric>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#include "accuracy_scheduler.h"
 #include "graph.h"
 #include "flute.h"
+#include "node_index.h"
+#include "segment_index.h"
+#include "thread_pool.h"
+#include "tree_cache.h"
 
 namespace steiner {
 
 namespace Flute = ::Flute;
 
-// Hash for pair of nodes
-struct pair_hash {
-  std::size_t operator()(const std::pair<graph::Node_i, graph::Node_i>& p) const {
-    auto h1 = std::hash<int>()(p.first.x) ^ (std::hash<int>()(p.first.y) << 1);
-    auto h2 = std::hash<int>()(p.second.x) ^ (std::hash<int>()(p.second.y) << 1);
-    return h1 ^ (h2 << 1);
-  }
-};
-
-// Return canonical edge order (lexicographic)
-std::pair<graph::Node_i, graph::Node_i> canonical(const graph::Node_i& a, const graph::Node_i& b) {
-  return (std::tie(a.x, a.y) < std::tie(b.x, b.y)) ? std::make_pair(a, b) : std::make_pair(b, a);
-}
-
-// Get list of all nodes strictly between p1 and p2 that exist in all_nodes
+// Get list of all nodes strictly between p1 and p2 that exist in the index.
+// As with the per-coordinate scan this replaces, only a segment running from
+// p1 towards increasing coordinates is searched.
 std::vector<graph::Node_i> get_nodes_between(const graph::Node_i& p1, const graph::Node_i& p2,
-                                             const std::unordered_set<graph::Node_i>& all_nodes) {
-  std::vector<graph::Node_i> nodes_between;
-
-  if (p1.y == p2.y) {
-    int y = p1.y;
-    for (int x = p1.x + 1; x < p2.x; ++x) {
-      if (all_nodes.count(graph::Node_i(x, y))) {
-        nodes_between.emplace_back(x, y);
-      }
-    }
-  } else if (p1.x == p2.x) {
-    int x = p1.x;
-    for (int y = p1.y + 1; y < p2.y; ++y) {
-      if (all_nodes.count(graph::Node_i(x, y))) {
-        nodes_between.emplace_back(x, y);
-      }
-    }
+                                             const NodeIndex& all_nodes) {
+  if ((p1.y == p2.y && p1.x < p2.x) || (p1.x == p2.x && p1.y < p2.y)) {
+    return all_nodes.NodesBetween(p1, p2);
   }
-
-  return nodes_between;
+  return {};
 }
 
-// Check if a new edge would overlap and return adjusted or split edges
-std::vector<std::pair<graph::Node_i, graph::Node_i>>
-resolve_overlap(const graph::Node_i& a, const graph::Node_i& b,
-                const std::unordered_set<std::pair<graph::Node_i, graph::Node_i>, pair_hash>& seen,
-                const std::unordered_set<graph::Node_i>& all_nodes) {
-  
-  graph::Node_i p1 = (std::tie(a.x, a.y) < std::tie(b.x, b.y)) ? a : b;
-  graph::Node_i p2 = (std::tie(a.x, a.y) < std::tie(b.x, b.y)) ? b : a;
-
-  // Check overlap against existing edges and split if necessary
-  for (const auto& edge : seen) {
-    graph::Node_i q1 = edge.first;
-    graph::Node_i q2 = edge.second;
-    if (std::tie(q1.x, q1.y) > std::tie(q2.x, q2.y)) std::swap(q1, q2);
-
-    if (p1.x == p2.x && q1.x == q2.x && p1.x == q1.x) {
-      // Vertical overlap
-      int p_start = std::min(p1.y, p2.y);
-      int p_end = std::max(p1.y, p2.y);
-      int q_start = std::min(q1.y, q2.y);
-      int q_end = std::max(q1.y, q2.y);
-
-      if (!(p_end <= q_start || p_start >= q_end)) {
-        // Overlapping intervals, split edge into disjoint parts excluding the overlapping region
-        std::vector<std::pair<graph::Node_i, graph::Node_i>> parts;
-
-        if (p_start < q_start) {
-          auto first_part = resolve_overlap(p1, graph::Node_i(p1.x, q_start), seen, all_nodes);
-          parts.insert(parts.end(), first_part.begin(), first_part.end());
-        }
-        if (p_end > q_end) {
-          auto second_part = resolve_overlap(graph::Node_i(p1.x, q_end), p2, seen, all_nodes);
-          parts.insert(parts.end(), second_part.begin(), second_part.end());
-        }
-        return parts;
-      }
-    }
+namespace {
 
-    if (p1.y == p2.y && q1.y == q2.y && p1.y == q1.y) {
-      // Horizontal overlap
-      int p_start = std::min(p1.x, p2.x);
-      int p_end = std::max(p1.x, p2.x);
-      int q_start = std::min(q1.x, q2.x);
-      int q_end = std::max(q1.x, q2.x);
+// Coordinate-indexed line tables pay off once a net has at least a quarter as
+// many nodes as its bounding box has rows and columns; below that, most lines
+// are empty and hashing the occupied ones is cheaper.
+constexpr int kDenseLinesPerNode = 4;
 
-      if (!(p_end <= q_start || p_start >= q_end)) {
-        std::vector<std::pair<graph::Node_i, graph::Node_i>> parts;
+// Nets are estimated in tasks of at least this many pins, rather than one
+// task per net.
+constexpr std::size_t kEstimatePinsPerTask = 4096;
 
-        if (p_start < q_start) {
-          auto first_part = resolve_overlap(p1, graph::Node_i(q_start, p1.y), seen, all_nodes);
-          parts.insert(parts.end(), first_part.begin(), first_part.end());
-        }
-        if (p_end > q_end) {
-          auto second_part = resolve_overlap(graph::Node_i(q_end, p1.y), p2, seen, all_nodes);
-          parts.insert(parts.end(), second_part.begin(), second_part.end());
-        }
-        return parts;
-      }
-    }
+// Returns the total length of the edges.
+long long Length(const std::vector<graph::Edge_i>& edges) {
+  long long length = 0;
+  for (const graph::Edge_i& e : edges) {
+    length += std::abs(static_cast<long long>(e.end.x) - e.start.x) +
+              std::abs(static_cast<long long>(e.end.y) - e.start.y);
   }
+  return length;
+}
 
-  // No overlap, split at intermediate nodes (all nodes between p1 and p2)
-  std::vector<graph::Node_i> intermediate_nodes;
-  if (p1.x == p2.x) {
-    int x = p1.x;
-    for (const auto& node : all_nodes) {
-      if (node.x == x && node.y > p1.y && node.y < p2.y) {
-        intermediate_nodes.push_back(node);
-      }
-    }
-    std::sort(intermediate_nodes.begin(), intermediate_nodes.end(), [](const auto& n1, const auto& n2) {
-      return n1.y < n2.y;
-    });
-  } else if (p1.y == p2.y) {
-    int y = p1.y;
-    for (const auto& node : all_nodes) {
-      if (node.y == y && node.x > p1.x && node.x < p2.x) {
-        intermediate_nodes.push_back(node);
-      }
-    }
-    std::sort(intermediate_nodes.begin(), intermediate_nodes.end(), [](const auto& n1, const auto& n2) {
-      return n1.x < n2.x;
-    });
+}  // namespace
+
+std::vector<graph::Edge_i> SteinerTreeBuilder::Solve(
+    const graph::Boundary_i& boundary,
+    const std::vector<graph::Node_i>& nodes, ThreadPool* pool,
+    int* accuracy) {
+  int solved_accuracy;
+  std::vector<graph::Edge_i> edges;
+  if (scheduler_ == nullptr) {
+    edges = SolveAt(boundary, nodes, AccuracyScheduler::kMaxAccuracy, pool,
+                    &solved_accuracy);
   } else {
-    // Not axis aligned, return as is
-    return { std::make_pair(p1, p2) };
+    // In anytime mode, the net is first solved at the accuracy that takes no
+    // time, i.e., the lowest one unless the net is solved from the tables.
+    const int degree = static_cast<int>(nodes.size());
+    const Clock::time_point start = Clock::now();
+    edges = SolveAt(boundary, nodes,
+                    scheduler_->Choose(degree, scheduler_->anytime()
+                                                   ? Clock::duration()
+                                                   : scheduler_->NetBudget()),
+                    pool, &solved_accuracy);
+    bool upgraded = false;
+    if (scheduler_->anytime()) {
+      upgraded = Upgrade(boundary, nodes,
+                         scheduler_->NetBudget(1.0, Clock::now() - start), pool,
+                         &edges, &solved_accuracy);
+    }
+    scheduler_->CountNet(solved_accuracy, upgraded);
+  }
+  if (accuracy != nullptr) {
+    *accuracy = solved_accuracy;
   }
+  return edges;
+}
 
-  // Build edges p1 -> intermediate nodes -> p2
-  std::vector<std::pair<graph::Node_i, graph::Node_i>> result;
-  graph::Node_i last = p1;
-  for (const auto& node : intermediate_nodes) {
-    if (!(last == node)) {
-      result.emplace_back(last, node);
+std::vector<graph::Edge_i> SteinerTreeBuilder::SolveAt(
+    const graph::Boundary_i& boundary,
+    const std::vector<graph::Node_i>& nodes, int accuracy, ThreadPool* pool,
+    int* solved_accuracy) {
+  *solved_accuracy = accuracy;
+  auto build = [&] {
+    if (scheduler_ == nullptr) {
+      return Build(boundary, nodes, accuracy, pool);
     }
-    last = node;
-  }
-  if (!(last == p2)) {
-    result.emplace_back(last, p2);
+    const Clock::time_point start = Clock::now();
+    std::vector<graph::Edge_i> edges = Build(boundary, nodes, accuracy, pool);
+    scheduler_->Record(static_cast<int>(nodes.size()), accuracy,
+                       Clock::now() - start);
+    return edges;
+  };
+  if (cache_ == nullptr || nodes.size() <= 1) {
+    return build();
   }
 
-  return result;
+  // Translating a net translates its tree: FLUTE works on the ranks and
+  // distances of the pins, and the boundary is not used. Nets listing the
+  // same pins in orders that FLUTE breaks ties by differently have different
+  // patterns. A cached tree of a higher accuracy is as good an answer.
+  const TreeCache::Pattern pattern(nodes);
+  std::vector<graph::Edge_i> edges;
+  if (!cache_->Lookup(pattern, &edges, accuracy, solved_accuracy)) {
+    edges = build();
+    cache_->Insert(pattern, edges, accuracy);
+  }
+  return edges;
 }
 
+bool SteinerTreeBuilder::Upgrade(const graph::Boundary_i& boundary,
+                                 const std::vector<graph::Node_i>& nodes,
+                                 Clock::duration budget, ThreadPool* pool,
+                                 std::vector<graph::Edge_i>* edges,
+                                 int* accuracy) {
+  const int target =
+      scheduler_->Choose(static_cast<int>(nodes.size()), budget);
+  if (target <= *accuracy) {
+    return false;
+  }
+  int upgraded_accuracy;
+  std::vector<graph::Edge_i> upgraded =
+      SolveAt(boundary, nodes, target, pool, &upgraded_accuracy);
+  // A higher accuracy tries more breakings, which usually but not always
+  // gives a shorter tree.
+  if (Length(upgraded) > Length(*edges)) {
+    return false;
+  }
+  *edges = std::move(upgraded);
+  *accuracy = upgraded_accuracy;
+  return true;
+}
 
-
-std::vector<graph::Edge_i> SteinerTreeBuilder::Solve(
+std::vector<graph::Edge_i> SteinerTreeBuilder::Build(
     const graph::Boundary_i& /*boundary*/,
-    const std::vector<graph::Node_i>& nodes) {
+    const std::vector<graph::Node_i>& nodes, int accuracy, ThreadPool* pool) {
 
   std::vector<graph::Edge_i> edges;
   int n = static_cast<int>(nodes.size());
   if (n <= 1) return edges;
 
-  static bool lut_loaded = false;
-  if (!lut_loaded) {
-    Flute::readLUT();
-    lut_loaded = true;
-  }
+  Flute::readLUT();
 
+  // FLUTE places the Steiner points on the Hanan grid of the nodes, so the
+  // tree stays within the boundary without being told about it.
   std::vector<int> x(n), y(n);
   for (int i = 0; i < n; ++i) {
     x[i] = nodes[i].x;
     y[i] = nodes[i].y;
   }
 
-  Flute::Tree tree = Flute::flute(n, x.data(), y.data(), 9);
-  std::unordered_set<std::pair<graph::Node_i, graph::Node_i>, pair_hash> seen;
-  std::unordered_set<graph::Node_i> all_nodes;
-
-  for (int i = 0; i < 2 * tree.deg - 2; ++i) {
-    all_nodes.emplace(tree.branch[i].x, tree.branch[i].y);
+  Flute::Tree tree;
+  if (pool != nullptr) {
+    Flute::Executor executor = [pool](int num_tasks,
+                                      const std::function<void(int)>& task) {
+      TaskGroup group(pool);
+      for (int i = 0; i < num_tasks; ++i) {
+        group.Run([&task, i] { task(i); });
+      }
+      group.Wait();
+    };
+    tree = Flute::flute_parallel(n, x.data(), y.data(), accuracy, executor);
+  } else {
+    tree = Flute::flute(n, x.data(), y.data(), accuracy);
   }
 
-  std::vector<std::pair<graph::Node_i, graph::Node_i>> diagonal_edges;
-
-  int num_branches = 2 * tree.deg - 2;
-  for (int i = 0; i < num_branches; ++i) {
-    int j = tree.branch[i].n;
+  const int num_points = 2 * tree.deg - 2;
+  std::vector<graph::Node_i> points;
+  std::vector<std::pair<int, int>> links;
+  points.reserve(num_points);
+  links.reserve(num_points);
+  for (int i = 0; i < num_points; ++i) {
+    points.emplace_back(tree.branch[i].x, tree.branch[i].y);
+    links.emplace_back(i, tree.branch[i].n);
+  }
+  Flute::free_tree(tree);
 
-    graph::Node_i p1(tree.branch[i].x, tree.branch[i].y);
-    graph::Node_i p2(tree.branch[j].x, tree.branch[j].y);
+  return EmbedTree(points, links);
+}
 
-    if (p1 == p2) continue;
+long long SteinerTreeBuilder::EstimateWirelength(
+    const std::vector<graph::Node_i>& nodes) {
+  const int n = static_cast<int>(nodes.size());
+  if (n <= 1) return 0;
+
+  // flute_wl() sorts the pins into its own arena; only the coordinates are
+  // copied here, into buffers that the thread keeps for its next net.
+  thread_local std::vector<int> x, y;
+  x.resize(n);
+  y.resize(n);
+  for (int i = 0; i < n; ++i) {
+    x[i] = nodes[i].x;
+    y[i] = nodes[i].y;
+  }
+  return Flute::flute_wl(n, x.data(), y.data(),
+                         AccuracyScheduler::kMaxAccuracy);
+}
 
-    if (p1.x == p2.x || p1.y == p2.y) {
-      auto new_edges = resolve_overlap(p1, p2, seen, all_nodes);
-      for (const auto& e : new_edges) {
-        auto canon = canonical(e.first, e.second);
-        if (seen.find(canon) == seen.end()) {
-          edges.emplace_back(canon.first, canon.second);
-          seen.insert(canon);
+std::vector<long long> SteinerTreeBuilder::EstimateWirelengths(
+    const std::vector<graph::Net_i>& nets, int num_threads) {
+  std::vector<long long> lengths(nets.size());
+
+  ThreadPool pool(num_threads);
+  TaskGroup group(&pool);
+  std::size_t begin = 0;
+  std::size_t num_pins = 0;
+  for (std::size_t i = 0; i < nets.size(); ++i) {
+    num_pins += nets[i].nodes.size();
+    if (num_pins >= kEstimatePinsPerTask || i + 1 == nets.size()) {
+      group.Run([this, &nets, &lengths, begin, end = i + 1] {
+        for (std::size_t j = begin; j < end; ++j) {
+          lengths[j] = EstimateWirelength(nets[j].nodes);
         }
-      }
-    } else {
-      diagonal_edges.emplace_back(p1, p2);
+      });
+      begin = i + 1;
+      num_pins = 0;
     }
   }
+  group.Wait();
+
+  return lengths;
+}
 
+std::vector<graph::Edge_i> SteinerTreeBuilder::EmbedTree(
+    const std::vector<graph::Node_i>& points,
+    const std::vector<std::pair<int, int>>& links) {
+  std::vector<graph::Edge_i> edges;
+  if (points.empty()) return edges;
+
+  graph::Boundary_i box(points[0].x, points[0].y, points[0].x, points[0].y);
+  for (const graph::Node_i& p : points) {
+    box.xl = std::min(box.xl, p.x);
+    box.yl = std::min(box.yl, p.y);
+    box.xh = std::max(box.xh, p.x);
+    box.yh = std::max(box.yh, p.y);
+  }
+  const long long num_lines = static_cast<long long>(box.xh) - box.xl +
+                              static_cast<long long>(box.yh) - box.yl + 2;
+  std::optional<SegmentIndex> index_storage;
+  if (num_lines <=
+      kDenseLinesPerNode * static_cast<long long>(points.size() / 2 + 1)) {
+    index_storage.emplace(box);
+  } else {
+    index_storage.emplace();
+  }
+  SegmentIndex& index = *index_storage;
+  for (const graph::Node_i& p : points) {
+    index.AddNode(p);
+  }
+
+  // Adds the parts of (a, b) not yet covered by the tree.
   auto try_add = [&](const graph::Node_i& a, const graph::Node_i& b) {
-    auto new_edges = resolve_overlap(a, b, seen, all_nodes);
-    for (const auto& e : new_edges) {
-      auto canon = canonical(e.first, e.second);
-      if (seen.find(canon) == seen.end()) {
-        edges.emplace_back(canon.first, canon.second);
-        seen.insert(canon);
+    for (const auto& e : index.Resolve(a, b)) {
+      if (index.Insert(e)) {
+        edges.emplace_back(e.first, e.second);
       }
     }
   };
 
+  std::vector<std::pair<graph::Node_i, graph::Node_i>> diagonal_edges;
+
+  for (const auto& [i, j] : links) {
+    const graph::Node_i& p1 = points[i];
+    const graph::Node_i& p2 = points[j];
+
+    if (p1 == p2) continue;
+
+    if (p1.x == p2.x || p1.y == p2.y) {
+      try_add(p1, p2);
+    } else {
+      diagonal_edges.emplace_back(p1, p2);
+    }
+  }
+
   for (const auto& [p1, p2] : diagonal_edges) {
     graph::Node_i mid1(p1.x, p2.y);
     graph::Node_i mid2(p2.x, p1.y);
 
     bool valid = (p1 != mid1 && mid1 != p2) &&
-                  !resolve_overlap(p1, mid1, seen, all_nodes).empty() &&
-                  !resolve_overlap(mid1, p2, seen, all_nodes).empty() &&
-                  get_nodes_between(p1, mid1, all_nodes).empty() &&
-                  get_nodes_between(mid1, p2, all_nodes).empty();
+                  !index.IsCovered(p1, mid1) &&
+                  !index.IsCovered(mid1, p2) &&
+                  get_nodes_between(p1, mid1, index.nodes()).empty() &&
+                  get_nodes_between(mid1, p2, index.nodes()).empty();
 
     if (valid) {
       try_add(p1, mid1);
       try_add(mid1, p2);
-      all_nodes.insert(mid1);
+      index.AddNode(mid1);
     } else {
       try_add(p1, mid2);
       try_add(mid2, p2);
-      all_nodes.insert(mid2);
+      index.AddNode(mid2);
     }
   }
 
   return edges;
 }
 
+std::vector<std::vector<graph::Edge_i>> SteinerTreeBuilder::SolveBatch(
+    const std::vector<graph::Net_i>& nets, int num_threads,
+    std::vector<int>* accuracies) {
+  std::vector<std::vector<graph::Edge_i>> trees(nets.size());
+  std::vector<int> accuracy(nets.size());
+
+  // Largest nets first, so that the small ones fill the gaps at the end.
+  std::vector<std::size_t> order(nets.size());
+  std::iota(order.begin(), order.end(), 0);
+  std::stable_sort(order.begin(), order.end(), [&](std::size_t a, std::size_t b) {
+    return nets[a].nodes.size() > nets[b].nodes.size();
+  });
+
+  ThreadPool pool(num_threads);
+  if (scheduler_ != nullptr) {
+    ScheduleBatch(nets, order, &pool, &trees, &accuracy);
+  } else {
+    TaskGroup group(&pool);
+    for (std::size_t i : order) {
+      group.Run([this, &nets, &trees, &accuracy, &pool, i] {
+        trees[i] = Solve(nets[i].boundary, nets[i].nodes, &pool, &accuracy[i]);
+      });
+    }
+    group.Wait();
+  }
+
+  if (accuracies != nullptr) {
+    *accuracies = std::move(accuracy);
+  }
+  return trees;
+}
+
+void SteinerTreeBuilder::ScheduleBatch(
+    const std::vector<graph::Net_i>& nets,
+    const std::vector<std::size_t>& order, ThreadPool* pool,
+    std::vector<std::vector<graph::Edge_i>>* trees,
+    std::vector<int>* accuracies) {
+  // A net gets the share of the time left until the deadline that its
+  // predicted time is of the nets not started yet, times the number of
+  // workers.
+  std::vector<double> work(nets.size());
+  double total_work = 0.0;
+  for (std::size_t i = 0; i < nets.size(); ++i) {
+    const int degree = static_cast<int>(nets[i].nodes.size());
+    work[i] = 1.0 + static_cast<double>(
+                        scheduler_
+                            ->Predict(degree, AccuracyScheduler::kMaxAccuracy)
+                            .count());
+    total_work += work[i];
+  }
+  const double num_workers = pool->num_threads();
+  std::mutex mutex;  // Guards pending_work.
+  double pending_work = total_work;
+  auto start_net = [&](std::size_t i) {
+    std::lock_guard<std::mutex> lock(mutex);
+    const double share = num_workers * work[i] / pending_work;
+    pending_work -= work[i];
+    return share;
+  };
+
+  const bool anytime = scheduler_->anytime();
+  std::vector<Clock::duration> spent(nets.size());
+  {
+    // Without anytime mode, this is the only pass. With it, every net is
+    // solved at the accuracy that takes no time first.
+    TaskGroup group(pool);
+    for (std::size_t i : order) {
+      group.Run([&, i] {
+        const Clock::time_point start = Clock::now();
+        const int degree = static_cast<int>(nets[i].nodes.size());
+        const Clock::duration budget =
+            anytime ? Clock::duration() : scheduler_->NetBudget(start_net(i));
+        (*trees)[i] = SolveAt(nets[i].boundary, nets[i].nodes,
+                              scheduler_->Choose(degree, budget), pool,
+                              &(*accuracies)[i]);
+        spent[i] = Clock::now() - start;
+        if (!anytime) {
+          scheduler_->CountNet((*accuracies)[i], false);
+        }
+      });
+    }
+    group.Wait();
+  }
+  if (!anytime) {
+    return;
+  }
+
+  // Upgrade the trees with the time left.
+  TaskGroup group(pool);
+  for (std::size_t i : order) {
+    group.Run([&, i] {
+      const bool upgraded =
+          Upgrade(nets[i].boundary, nets[i].nodes,
+                  scheduler_->NetBudget(start_net(i), spent[i]), pool,
+                  &(*trees)[i], &(*accuracies)[i]);
+      scheduler_->CountNet((*accuracies)[i], upgraded);
+    });
+  }
+  group.Wait();
+}
+
+bool SteinerTreeBuilder::SolveStream(
+    const std::function<bool(graph::Net_i*)>& next_net,
+    const std::function<bool(std::vector<graph::Edge_i>&)>& emit,
+    const std::function<bool()>& flush, int num_threads,
+    std::size_t max_in_flight) {
+  // A net between the read and the write stages.
+  struct Slot {
+    graph::Net_i net;
+    std::vector<graph::Edge_i> tree;
+    bool done = false;
+  };
+
+  std::mutex mutex;                // Guards the state below.
+  std::condition_variable changed;
+  std::deque<std::unique_ptr<Slot>> in_flight;
+  bool end_of_input = false;
+  bool stopped = false;            // Set if emit or flush failed.
+
+  ThreadPool pool(num_threads);
+  if (max_in_flight == 0) {
+    max_in_flight = 4 * static_cast<std::size_t>(pool.num_threads());
+  }
+
+  // Write stage.
+  std::thread writer([&] {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+      const bool ready = !in_flight.empty() && in_flight.front()->done;
+      const bool finished = in_flight.empty() && end_of_input;
+      std::unique_ptr<Slot> slot;
+      if (ready) {
+        slot = std::move(in_flight.front());
+        in_flight.pop_front();
+        changed.notify_all();
+      }
+      lock.unlock();
+      // Flush whenever the next tree is not done yet.
+      const bool ok = ready ? emit(slot->tree) : flush();
+      slot.reset();
+      lock.lock();
+      if (!ok) {
+        stopped = true;
+        changed.notify_all();
+        return;
+      }
+      if (finished) {
+        return;
+      }
+      if (!ready) {
+        changed.wait(lock, [&] {
+          return (!in_flight.empty() && in_flight.front()->done) ||
+                 (in_flight.empty() && end_of_input);
+        });
+      }
+    }
+  });
+
+  // Read stage. The solve stage runs on the pool.
+  TaskGroup group(&pool);
+  while (true) {
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      changed.wait(lock,
+                   [&] { return stopped || in_flight.size() < max_in_flight; });
+      if (stopped) {
+        break;
+      }
+    }
+    auto slot = std::make_unique<Slot>();
+    if (!next_net(&slot->net)) {
+      break;
+    }
+    Slot* net = slot.get();
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      in_flight.push_back(std::move(slot));
+    }
+    group.Run([this, net, &pool, &mutex, &changed] {
+      std::vector<graph::Edge_i> tree =
+          Solve(net->net.boundary, net->net.nodes, &pool);
+      std::lock_guard<std::mutex> lock(mutex);
+      net->tree = std::move(tree);
+      net->done = true;
+      changed.notify_all();
+    });
+  }
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    end_of_input = true;
+  }
+  changed.notify_all();
+
+  group.Wait();
+  writer.join();
+  return !stopped;
+}
+
 }  // namespace steiner
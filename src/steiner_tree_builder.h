@@ -4,16 +4,30 @@
 #ifndef STEINER_TREE_BUILDER_H_
 #define STEINER_TREE_BUILDER_H_
 
+#include <chrono>
+#include <cstddef>
+#include <functional>
+#include <utility>
 #include <vector>
 
 #include "graph.h"
 
 namespace steiner {
 
+class AccuracyScheduler;
+class ThreadPool;
+class TreeCache;
+
 class SteinerTreeBuilder {
  public:
   // Constructors and destructor.
-  SteinerTreeBuilder() = default;
+  // With a `cache`, Solve() answers a net whose pins are a translation of an
+  // earlier net's from it, and caches the trees it builds. With a
+  // `scheduler`, the FLUTE accuracy of each net is chosen by it instead of
+  // always being AccuracyScheduler::kMaxAccuracy.
+  explicit SteinerTreeBuilder(TreeCache* cache = nullptr,
+                              AccuracyScheduler* scheduler = nullptr)
+      : cache_(cache), scheduler_(scheduler) {}
   SteinerTreeBuilder(const SteinerTreeBuilder&) = delete;
   SteinerTreeBuilder& operator=(const SteinerTreeBuilder&) = delete;
   SteinerTreeBuilder(SteinerTreeBuilder&&) = delete;
@@ -21,8 +35,89 @@ class SteinerTreeBuilder {
   ~SteinerTreeBuilder() = default;
 
   // Solves the Steiner tree problem and returns the edges of the Steiner tree.
+  // With a `pool`, the breakings of large nets are solved as tasks on it; the
+  // tree is the same. Sets `accuracy`, if given, to the FLUTE accuracy of the
+  // tree. Solve() may be called from several threads at once.
   std::vector<graph::Edge_i> Solve(const graph::Boundary_i& boundary,
-                                   const std::vector<graph::Node_i>& nodes);
+                                   const std::vector<graph::Node_i>& nodes,
+                                   ThreadPool* pool = nullptr,
+                                   int* accuracy = nullptr);
+
+  // Returns the length of the Steiner tree of `nodes` without building it:
+  // the length of the tree that FLUTE would build, which the embedding of
+  // Solve() can only shorten. May be called from several threads at once.
+  long long EstimateWirelength(const std::vector<graph::Node_i>& nodes);
+
+  // Returns the estimated length of the Steiner tree of every net, in the
+  // order of `nets`, computed on `num_threads` worker threads (one per
+  // hardware thread if <= 0).
+  std::vector<long long> EstimateWirelengths(
+      const std::vector<graph::Net_i>& nets, int num_threads = 0);
+
+  // Embeds a tree whose nodes are `points`, connected by `links` (pairs of
+  // indices into `points`), and returns its edges. A diagonal link is bent
+  // into an L shape, at the corner that does not run over the rest of the
+  // tree if there is one.
+  static std::vector<graph::Edge_i> EmbedTree(
+      const std::vector<graph::Node_i>& points,
+      const std::vector<std::pair<int, int>>& links);
+
+  // Solves the Steiner tree problem for every net on `num_threads` worker
+  // threads (one per hardware thread if <= 0) and returns the edges of each
+  // Steiner tree, in the order of `nets`. Nets are scheduled by decreasing
+  // degree so that large nets do not finish last, and large nets are split
+  // into tasks on the same threads. With a scheduler, the nets share the time
+  // left until its deadline in proportion to their predicted times. Sets
+  // `accuracies`, if given, to the FLUTE accuracy of each tree.
+  std::vector<std::vector<graph::Edge_i>> SolveBatch(
+      const std::vector<graph::Net_i>& nets, int num_threads = 0,
+      std::vector<int>* accuracies = nullptr);
+
+  // Solves a stream of nets in three pipelined stages: the calling thread
+  // reads nets with `next_net` until it returns false, `num_threads` worker
+  // threads (one per hardware thread if <= 0) solve them, and a writer thread
+  // passes their trees to `emit` in the order of the nets, each as soon as it
+  // and every earlier tree are done. The writer calls `flush` whenever it
+  // waits for a tree. At most `max_in_flight` nets (4 per worker if 0) are
+  // read but not yet emitted, which bounds the memory. Returns false if
+  // `emit` or `flush` failed, which stops the stream.
+  bool SolveStream(const std::function<bool(graph::Net_i*)>& next_net,
+                   const std::function<bool(std::vector<graph::Edge_i>&)>& emit,
+                   const std::function<bool()>& flush, int num_threads = 0,
+                   std::size_t max_in_flight = 0);
+
+ private:
+  using Clock = std::chrono::steady_clock;
+
+  // Solves the Steiner tree problem as Solve() does, at `accuracy` or from a
+  // cached tree of at least that accuracy, and sets `solved_accuracy` to the
+  // accuracy of the tree.
+  std::vector<graph::Edge_i> SolveAt(const graph::Boundary_i& boundary,
+                                     const std::vector<graph::Node_i>& nodes,
+                                     int accuracy, ThreadPool* pool,
+                                     int* solved_accuracy);
+
+  // Solves the Steiner tree problem as SolveAt() does, without the cache.
+  std::vector<graph::Edge_i> Build(const graph::Boundary_i& boundary,
+                                   const std::vector<graph::Node_i>& nodes,
+                                   int accuracy, ThreadPool* pool);
+
+  // Solves the net again at the accuracy the scheduler chooses for `budget`,
+  // if that is higher than `accuracy`, and replaces `edges` and `accuracy` if
+  // the new tree is not longer. Returns true if it replaced them.
+  bool Upgrade(const graph::Boundary_i& boundary,
+               const std::vector<graph::Node_i>& nodes, Clock::duration budget,
+               ThreadPool* pool, std::vector<graph::Edge_i>* edges,
+               int* accuracy);
+
+  // Solves the nets of SolveBatch() in `order` with the scheduler.
+  void ScheduleBatch(const std::vector<graph::Net_i>& nets,
+                     const std::vector<std::size_t>& order, ThreadPool* pool,
+                     std::vector<std::vector<graph::Edge_i>>* trees,
+                     std::vector<int>* accuracies);
+
+  TreeCache* cache_;
+  AccuracyScheduler* scheduler_;
 };
 
 }  // namespace steiner
@@ -0,0 +1,179 @@
+/*******************************************************************************
+ * Feel free to use, modify, and/or distribute this code as you see fit.
+ ******************************************************************************/
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+
+namespace steiner {
+
+namespace {
+
+// The pool and the index of the worker running on the current thread.
+thread_local const ThreadPool* current_pool = nullptr;
+thread_local int current_worker = -1;
+
+// Times a thread in HelpUntil() yields without finding a task before it
+// sleeps. Tasks are often submitted in bursts, which the spin catches without
+// a wake-up.
+constexpr int kHelperSpins = 64;
+
+}  // namespace
+
+ThreadPool::ThreadPool(int num_threads) {
+  if (num_threads <= 0) {
+    num_threads =
+        std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+  }
+  for (int i = 0; i < num_threads; ++i) {
+    queues_.push_back(std::make_unique<Queue>());
+  }
+  for (int i = 0; i < num_threads; ++i) {
+    workers_.emplace_back(&ThreadPool::WorkerLoop, this, i);
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  wake_.notify_all();
+  for (std::thread& worker : workers_) {
+    worker.join();
+  }
+}
+
+void ThreadPool::Submit(std::function<void()> task) {
+  // A worker pushes to the front of its own queue, so that it picks up the
+  // subtasks it is waiting for first. Other threads spread tasks round-robin.
+  if (current_pool == this) {
+    Queue& queue = *queues_[current_worker];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    queue.tasks.push_front(std::move(task));
+  } else {
+    Queue& queue = *queues_[next_queue_++ % queues_.size()];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    queue.tasks.push_back(std::move(task));
+  }
+  pending_.fetch_add(1);
+  bool helpers;
+  {
+    // Pairs with the predicate check of a thread about to sleep.
+    std::lock_guard<std::mutex> lock(mutex_);
+    helpers = num_helpers_ > 0;
+  }
+  wake_.notify_one();
+  if (helpers) {
+    helpers_wake_.notify_one();
+  }
+}
+
+void ThreadPool::HelpUntil(const std::function<bool()>& done) {
+  const int self = current_pool == this ? current_worker : -1;
+  std::function<void()> task;
+  int spins = 0;
+  while (!done()) {
+    if (TryPop(self, &task)) {
+      task();
+      task = nullptr;
+      spins = 0;
+    } else if (++spins < kHelperSpins) {
+      std::this_thread::yield();
+    } else {
+      std::unique_lock<std::mutex> lock(mutex_);
+      ++num_helpers_;
+      helpers_wake_.wait(lock, [this, &done] {
+        return pending_.load() > 0 || done();
+      });
+      --num_helpers_;
+      spins = 0;
+    }
+  }
+}
+
+void ThreadPool::NotifyHelpers() {
+  {
+    // Pairs with the predicate check of a thread about to sleep.
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (num_helpers_ == 0) {
+      return;
+    }
+  }
+  helpers_wake_.notify_all();
+}
+
+bool ThreadPool::TryPop(int self, std::function<void()>* task) {
+  if (pending_.load() == 0) {
+    return false;
+  }
+  const int num_queues = static_cast<int>(queues_.size());
+  if (self >= 0) {
+    Queue& queue = *queues_[self];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    if (!queue.tasks.empty()) {
+      *task = std::move(queue.tasks.front());
+      queue.tasks.pop_front();
+      pending_.fetch_sub(1);
+      return true;
+    }
+  }
+  for (int i = 1; i <= num_queues; ++i) {
+    const int victim = (std::max(self, 0) + i) % num_queues;
+    if (victim == self) {
+      continue;
+    }
+    Queue& queue = *queues_[victim];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    if (!queue.tasks.empty()) {
+      *task = std::move(queue.tasks.back());
+      queue.tasks.pop_back();
+      pending_.fetch_sub(1);
+      return true;
+    }
+  }
+  return false;
+}
+
+void ThreadPool::WorkerLoop(int index) {
+  current_pool = this;
+  current_worker = index;
+  std::function<void()> task;
+  while (true) {
+    if (TryPop(index, &task)) {
+      task();
+      task = nullptr;
+      continue;
+    }
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (stop_ && pending_.load() == 0) {
+      return;
+    }
+    wake_.wait(lock, [this] { return stop_ || pending_.load() > 0; });
+  }
+}
+
+void TaskGroup::Run(std::function<void()> task) {
+  unfinished_.fetch_add(1);
+  pool_->Submit([this, pool = pool_, task = std::move(task)] {
+    task();
+    // Once the count is zero, Wait() may return and destroy the group.
+    if (unfinished_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+      pool->NotifyHelpers();
+    }
+  });
+}
+
+void TaskGroup::Wait() {
+  pool_->HelpUntil([this] {
+    return unfinished_.load(std::memory_order_acquire) == 0;
+  });
+}
+
+}  // namespace steiner
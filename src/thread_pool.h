@@ -0,0 +1,97 @@
+/*******************************************************************************
+ * Feel free to use, modify, and/or distribute this code as you see fit.
+ ******************************************************************************/
+#ifndef THREAD_POOL_H_
+#define THREAD_POOL_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace steiner {
+
+// Thread pool.
+// Every worker owns a task queue. A worker takes tasks from the front of its
+// own queue and, when it runs dry, steals from the back of the other queues.
+// Tasks submitted from a worker go to that worker's queue, so a task may
+// submit and wait for subtasks (see TaskGroup) without deadlocking the pool.
+class ThreadPool {
+ public:
+  // Constructors and destructor.
+  // A pool with `num_threads` <= 0 uses one worker per hardware thread.
+  explicit ThreadPool(int num_threads = 0);
+  ThreadPool(const ThreadPool&) = delete;
+  ThreadPool& operator=(const ThreadPool&) = delete;
+  ThreadPool(ThreadPool&&) = delete;
+  ThreadPool& operator=(ThreadPool&&) = delete;
+  ~ThreadPool();
+
+  // Returns the number of workers.
+  int num_threads() const { return static_cast<int>(workers_.size()); }
+
+  // Schedules a task.
+  void Submit(std::function<void()> task);
+
+  // Runs pending tasks on the calling thread until `done` returns true. When
+  // there is nothing to run, the thread spins briefly and then sleeps until a
+  // task is submitted or NotifyHelpers() is called.
+  void HelpUntil(const std::function<bool()>& done);
+
+  // Wakes the threads sleeping in HelpUntil(), to check their `done` again.
+  void NotifyHelpers();
+
+ private:
+  // A task queue owned by one worker.
+  struct Queue {
+    std::mutex mutex;
+    std::deque<std::function<void()>> tasks;
+  };
+
+  // Takes a task from the queue of worker `self`, or steals one from another
+  // worker. Returns false if every queue is empty.
+  bool TryPop(int self, std::function<void()>* task);
+
+  // Main loop of worker `index`.
+  void WorkerLoop(int index);
+
+  std::vector<std::unique_ptr<Queue>> queues_;
+  std::vector<std::thread> workers_;
+  std::atomic<int> pending_{0};          // Number of queued tasks.
+  std::atomic<unsigned> next_queue_{0};  // Round-robin queue for outsiders.
+  std::mutex mutex_;                     // Guards the state below.
+  std::condition_variable wake_;         // Wakes sleeping workers.
+  std::condition_variable helpers_wake_;  // Wakes threads in HelpUntil().
+  int num_helpers_ = 0;                   // Threads sleeping in HelpUntil().
+  bool stop_ = false;
+};
+
+// Task group.
+// Runs a set of tasks on a thread pool and waits for all of them. The waiting
+// thread executes pending tasks, and only blocks when there are none.
+class TaskGroup {
+ public:
+  // Constructors and destructor.
+  explicit TaskGroup(ThreadPool* pool) : pool_(pool) {}
+  TaskGroup(const TaskGroup&) = delete;
+  TaskGroup& operator=(const TaskGroup&) = delete;
+  ~TaskGroup() { Wait(); }
+
+  // Schedules a task of the group.
+  void Run(std::function<void()> task);
+
+  // Waits until every task of the group has finished.
+  void Wait();
+
+ private:
+  ThreadPool* pool_;
+  std::atomic<int> unfinished_{0};
+};
+
+}  // namespace steiner
+
+#endif  // THREAD_POOL_H_
@@ -0,0 +1,152 @@
+/*******************************************************************************
+ * Feel free to use, modify, and/or distribute this code as you see fit.
+ ******************************************************************************/
+#include "tree_cache.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <mutex>
+#include <ostream>
+#include <utility>
+#include <vector>
+
+#include "graph.h"
+
+namespace steiner {
+
+namespace {
+
+// Memory of an entry besides its pins and edges: the list and index nodes.
+constexpr std::size_t kEntryOverhead = 96;
+
+// Translates `node` by `by`, or back with `sign` = -1. Coordinates wrap
+// around, so that a translation is undone exactly even if it overflows.
+graph::Node_i Translate(const graph::Node_i& node, const graph::Node_i& by,
+                        int sign) {
+  const std::uint32_t dx = static_cast<std::uint32_t>(by.x);
+  const std::uint32_t dy = static_cast<std::uint32_t>(by.y);
+  const std::uint32_t x = static_cast<std::uint32_t>(node.x);
+  const std::uint32_t y = static_cast<std::uint32_t>(node.y);
+  return graph::Node_i(static_cast<int>(sign > 0 ? x + dx : x - dx),
+                       static_cast<int>(sign > 0 ? y + dy : y - dy));
+}
+
+}  // namespace
+
+TreeCache::Pattern::Pattern(const std::vector<graph::Node_i>& nodes) {
+  if (nodes.empty()) {
+    return;
+  }
+  origin_ = nodes[0];
+  for (const graph::Node_i& node : nodes) {
+    origin_.x = std::min(origin_.x, node.x);
+    origin_.y = std::min(origin_.y, node.y);
+  }
+  pins_.reserve(nodes.size());
+  for (const graph::Node_i& node : nodes) {
+    pins_.push_back(Translate(node, origin_, -1));
+  }
+  // FLUTE sees the pins sorted by x, with pins tied in x in their input
+  // order, and takes those of a two-pin net as they are. Sorted the same
+  // way, nets share a pattern only if FLUTE builds the same tree for them.
+  if (pins_.size() > 2) {
+    std::stable_sort(pins_.begin(), pins_.end(),
+                     [](const graph::Node_i& a, const graph::Node_i& b) {
+                       return a.x < b.x;
+                     });
+  }
+
+  hash_ = pins_.size();
+  for (const graph::Node_i& pin : pins_) {
+    hash_ = graph::MixKey(hash_ ^ graph::PackNode(pin));
+  }
+}
+
+TreeCache::TreeCache(std::size_t max_bytes) : max_bytes_(max_bytes) {}
+
+bool TreeCache::Lookup(const Pattern& pattern,
+                       std::vector<graph::Edge_i>* edges, int min_accuracy,
+                       int* accuracy) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    ++num_lookups_;
+    auto it = index_.find(pattern.hash_);
+    if (it == index_.end() || it->second->pins != pattern.pins_ ||
+        it->second->accuracy < min_accuracy) {
+      return false;
+    }
+    ++num_hits_;
+    lru_.splice(lru_.begin(), lru_, it->second);
+    *edges = it->second->edges;
+    if (accuracy != nullptr) {
+      *accuracy = it->second->accuracy;
+    }
+  }
+
+  for (graph::Edge_i& edge : *edges) {
+    edge.start = Translate(edge.start, pattern.origin_, 1);
+    edge.end = Translate(edge.end, pattern.origin_, 1);
+  }
+  return true;
+}
+
+void TreeCache::Insert(const Pattern& pattern,
+                       const std::vector<graph::Edge_i>& edges, int accuracy) {
+  Entry entry;
+  entry.bytes = kEntryOverhead +
+                pattern.pins_.size() * sizeof(graph::Node_i) +
+                edges.size() * sizeof(graph::Edge_i);
+  if (entry.bytes > max_bytes_) {
+    return;
+  }
+  entry.pins = pattern.pins_;
+  entry.hash = pattern.hash_;
+  entry.accuracy = accuracy;
+  entry.edges.reserve(edges.size());
+  for (const graph::Edge_i& edge : edges) {
+    entry.edges.emplace_back(Translate(edge.start, pattern.origin_, -1),
+                             Translate(edge.end, pattern.origin_, -1));
+  }
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto [it, inserted] = index_.emplace(pattern.hash_, lru_.end());
+  if (!inserted) {
+    // Another thread cached the pattern first, or a different pattern has
+    // the same hash. Either way, the newer tree replaces the entry, unless
+    // it is the same pattern's at a lower accuracy.
+    if (it->second->accuracy > accuracy && it->second->pins == entry.pins) {
+      return;
+    }
+    bytes_ -= it->second->bytes;
+    lru_.erase(it->second);
+  }
+  bytes_ += entry.bytes;
+  lru_.push_front(std::move(entry));
+  it->second = lru_.begin();
+  Evict();
+}
+
+void TreeCache::Evict() {
+  while (bytes_ > max_bytes_) {
+    const Entry& entry = lru_.back();
+    bytes_ -= entry.bytes;
+    index_.erase(entry.hash);
+    lru_.pop_back();
+    ++num_evictions_;
+  }
+}
+
+void TreeCache::PrintStats(std::ostream& out) const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  out << "Tree cache: " << num_lookups_ << " lookups, " << num_hits_
+      << " hits";
+  if (num_lookups_ > 0) {
+    out << " (" << 100.0 * static_cast<double>(num_hits_) /
+                       static_cast<double>(num_lookups_)
+        << "%)";
+  }
+  out << ", " << lru_.size() << " trees in " << bytes_ << " of " << max_bytes_
+      << " bytes, " << num_evictions_ << " evicted\n";
+}
+
+}  // namespace steiner
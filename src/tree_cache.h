@@ -0,0 +1,93 @@
+/*******************************************************************************
+ * Feel free to use, modify, and/or distribute this code as you see fit.
+ ******************************************************************************/
+#ifndef TREE_CACHE_H_
+#define TREE_CACHE_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <ostream>
+#include <unordered_map>
+#include <vector>
+
+#include "graph.h"
+
+namespace steiner {
+
+// Tree cache.
+// Remembers the trees of recently solved nets by their pin pattern: the pins
+// in the order FLUTE sees them, translated so that their bounding box starts
+// at the origin. A net whose pins are a translation of a cached net, e.g.,
+// another instance of the same cell, is answered by translating the cached
+// tree, which is the tree that solving the net would give. The least recently
+// used trees are evicted to keep the cache within a memory budget. The cache
+// may be used from several threads at once.
+class TreeCache {
+ public:
+  // The pin pattern of a net and where the net lies.
+  class Pattern {
+   public:
+    explicit Pattern(const std::vector<graph::Node_i>& nodes);
+
+   private:
+    friend class TreeCache;
+
+    std::vector<graph::Node_i> pins_;  // Ordered and translated pins.
+    graph::Node_i origin_;             // Translation of the net.
+    std::uint64_t hash_ = 0;
+  };
+
+  // Constructors and destructor.
+  // The cache holds up to about `max_bytes` of trees and pin patterns.
+  explicit TreeCache(std::size_t max_bytes);
+  TreeCache(const TreeCache&) = delete;
+  TreeCache& operator=(const TreeCache&) = delete;
+  TreeCache(TreeCache&&) = delete;
+  TreeCache& operator=(TreeCache&&) = delete;
+  ~TreeCache() = default;
+
+  // Sets `edges` to the cached tree of `pattern`, translated to where its net
+  // lies, and `accuracy`, if given, to the FLUTE accuracy it was built at,
+  // and returns true, or returns false if the pattern is not cached at
+  // `min_accuracy` or higher.
+  bool Lookup(const Pattern& pattern, std::vector<graph::Edge_i>* edges,
+              int min_accuracy = 0, int* accuracy = nullptr);
+
+  // Caches `edges`, the tree of the net of `pattern` built at `accuracy`. A
+  // cached tree of the same pattern at a higher accuracy is kept instead.
+  void Insert(const Pattern& pattern, const std::vector<graph::Edge_i>& edges,
+              int accuracy);
+
+  // Prints the number of lookups, the hit rate and the memory used.
+  void PrintStats(std::ostream& out) const;
+
+ private:
+  // A cached tree, translated like the pins of its pattern.
+  struct Entry {
+    std::vector<graph::Node_i> pins;
+    std::vector<graph::Edge_i> edges;
+    std::uint64_t hash = 0;
+    int accuracy = 0;
+    std::size_t bytes = 0;  // Memory accounted to the entry.
+  };
+  using Lru = std::list<Entry>;
+
+  // Evicts the least recently used entries until the cache fits its budget.
+  void Evict();
+
+  const std::size_t max_bytes_;
+
+  mutable std::mutex mutex_;  // Guards the state below.
+  Lru lru_;                   // Most recently used first.
+  std::unordered_map<std::uint64_t, Lru::iterator> index_;  // By hash.
+  std::size_t bytes_ = 0;
+  std::uint64_t num_lookups_ = 0;
+  std::uint64_t num_hits_ = 0;
+  std::uint64_t num_evictions_ = 0;
+};
+
+}  // namespace steiner
+
+#endif  // TREE_CACHE_H_
@@ -0,0 +1,172 @@
+/*******************************************************************************
+ * Feel free to use, modify, and/or distribute this code as you see fit.
+ ******************************************************************************/
+// Applies random edits to incremental nets and checks after each one that the
+// embedded tree connects the pins and that its edges only meet at their ends.
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "graph.h"
+#include "incremental_net.h"
+
+namespace {
+
+constexpr int kNumSeeds = 60;
+constexpr int kNumEdits = 300;
+constexpr int kSpan = 40;  // Small, so that branches often meet.
+constexpr std::size_t kMaxPins = 40;
+
+// Returns an error message if `edges` is not a tree connecting `pins`, whose
+// leaves are pins, no longer than `wirelength`, and whose edges only meet at
+// their ends; an empty string otherwise.
+std::string Check(const std::vector<graph::Node_i>& pins,
+                  const std::vector<graph::Edge_i>& edges,
+                  long long wirelength) {
+  std::unordered_map<graph::Node_i, int> node_index;
+  std::vector<std::vector<int>> adjacent;
+  long long length = 0;
+  for (const graph::Edge_i& e : edges) {
+    if ((e.start.x != e.end.x && e.start.y != e.end.y) || e.start == e.end) {
+      return "edge neither horizontal nor vertical";
+    }
+    length += std::abs(e.start.x - e.end.x) + std::abs(e.start.y - e.end.y);
+    int ends[2];
+    for (int k = 0; k < 2; ++k) {
+      auto [it, inserted] = node_index.emplace(k == 0 ? e.start : e.end,
+                                               static_cast<int>(adjacent.size()));
+      if (inserted) {
+        adjacent.emplace_back();
+      }
+      ends[k] = it->second;
+    }
+    adjacent[ends[0]].push_back(ends[1]);
+    adjacent[ends[1]].push_back(ends[0]);
+  }
+  if (length > wirelength) {
+    return "edges longer than the wirelength";
+  }
+
+  // Any two edges share at most one point, which is an end of both.
+  for (std::size_t i = 0; i < edges.size(); ++i) {
+    const graph::Edge_i& a = edges[i];
+    for (std::size_t j = i + 1; j < edges.size(); ++j) {
+      const graph::Edge_i& b = edges[j];
+      const int xl = std::max(std::min(a.start.x, a.end.x),
+                              std::min(b.start.x, b.end.x));
+      const int xh = std::min(std::max(a.start.x, a.end.x),
+                              std::max(b.start.x, b.end.x));
+      const int yl = std::max(std::min(a.start.y, a.end.y),
+                              std::min(b.start.y, b.end.y));
+      const int yh = std::min(std::max(a.start.y, a.end.y),
+                              std::max(b.start.y, b.end.y));
+      if (xl > xh || yl > yh) {
+        continue;
+      }
+      if (xl < xh || yl < yh) {
+        return "overlapping edges";
+      }
+      const graph::Node_i p(xl, yl);
+      if ((p != a.start && p != a.end) || (p != b.start && p != b.end)) {
+        return "edges crossing or meeting away from their ends";
+      }
+    }
+  }
+
+  std::unordered_set<graph::Node_i> pin_set(pins.begin(), pins.end());
+  if (edges.empty()) {
+    return pin_set.size() <= 1 ? "" : "no edges between the pins";
+  }
+  if (edges.size() + 1 != adjacent.size()) {
+    return "edges not a tree";
+  }
+  std::vector<bool> reached(adjacent.size(), false);
+  std::vector<int> stack = {0};
+  reached[0] = true;
+  int num_reached = 0;
+  while (!stack.empty()) {
+    const int v = stack.back();
+    stack.pop_back();
+    ++num_reached;
+    for (int w : adjacent[v]) {
+      if (!reached[w]) {
+        reached[w] = true;
+        stack.push_back(w);
+      }
+    }
+  }
+  if (num_reached != static_cast<int>(adjacent.size())) {
+    return "edges not connected";
+  }
+  for (const graph::Node_i& pin : pin_set) {
+    if (node_index.count(pin) == 0) {
+      return "pin not on the tree";
+    }
+  }
+  for (const auto& [p, v] : node_index) {
+    if (adjacent[v].size() == 1 && pin_set.count(p) == 0) {
+      return "leaf that is not a pin";
+    }
+  }
+  return "";
+}
+
+}  // namespace
+
+int main() {
+  int num_failures = 0;
+  for (int seed = 0; seed < kNumSeeds; ++seed) {
+    std::mt19937 rng(seed);
+    auto random_node = [&rng] {
+      return graph::Node_i(static_cast<int>(rng() % kSpan),
+                           static_cast<int>(rng() % kSpan));
+    };
+    std::vector<graph::Node_i> pins;
+    for (int i = 0; i < 10; ++i) {
+      pins.push_back(random_node());
+    }
+    steiner::IncrementalNet net(graph::Boundary_i(0, 0, kSpan, kSpan), pins);
+    for (int edit = 0; edit <= kNumEdits; ++edit) {
+      const char* what = "constructor";
+      if (edit > 0) {
+        const int op = pins.size() < 3 ? 0
+                       : pins.size() >= kMaxPins ? 1
+                                                 : static_cast<int>(rng() % 3);
+        const std::size_t i = rng() % pins.size();
+        if (op == 0) {
+          what = "AddPin";
+          pins.push_back(random_node());
+          net.AddPin(pins.back());
+        } else if (op == 1) {
+          what = "RemovePin";
+          net.RemovePin(pins[i]);
+          pins.erase(pins.begin() + i);
+        } else {
+          what = "MovePin";
+          const graph::Node_i to = random_node();
+          net.MovePin(pins[i], to);
+          pins[i] = to;
+        }
+      }
+      const std::string error = Check(pins, net.Edges(), net.wirelength());
+      if (!error.empty()) {
+        std::cerr << "Seed " << seed << ", edit " << edit << " (" << what
+                  << "): " << error << std::endl;
+        ++num_failures;
+        break;
+      }
+    }
+  }
+  if (num_failures > 0) {
+    std::cerr << num_failures << " of " << kNumSeeds << " seeds failed"
+              << std::endl;
+    return 1;
+  }
+  std::cout << "All " << kNumSeeds << " seeds passed" << std::endl;
+  return 0;
+}